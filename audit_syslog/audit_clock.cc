@@ -0,0 +1,62 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: cheap monotonic clock for timing statements.
+*/
+
+#include "audit_clock.h"
+#include <stdio.h>
+#include <string.h>
+
+bool audit_clock_tsc= false;
+double audit_clock_usec_per_tick= 0.001;        /* CLOCK_MONOTONIC ticks are ns */
+
+#if defined(__x86_64__) || defined(__i386__)
+/* an invariant TSC ticks at one rate on all cores, also in idle states */
+static bool tsc_invariant(void)
+{
+  char line[4096];
+  bool constant= false, nonstop= false;
+  FILE *f= fopen("/proc/cpuinfo", "r");
+  if (!f)
+    return false;
+
+  while (fgets(line, sizeof(line), f))
+  {
+    if (strncmp(line, "flags", 5))
+      continue;
+    constant= strstr(line, " constant_tsc") != NULL;
+    nonstop= strstr(line, " nonstop_tsc") != NULL;
+    break;
+  }
+  fclose(f);
+  return constant && nonstop;
+}
+#endif
+
+void audit_clock_init(void)
+{
+  audit_clock_tsc= false;
+  audit_clock_usec_per_tick= 0.001;
+
+#if defined(__x86_64__) || defined(__i386__)
+  if (!tsc_invariant())
+    return;
+
+  /* count TSC ticks over 10ms of CLOCK_MONOTONIC */
+  struct timespec pause= { 0, 10 * 1000 * 1000 };
+  ulonglong ns_start= audit_clock_ticks();
+  audit_clock_tsc= true;
+  ulonglong tsc_start= audit_clock_ticks();
+  nanosleep(&pause, NULL);
+  ulonglong tsc_end= audit_clock_ticks();
+  audit_clock_tsc= false;
+  ulonglong ns_end= audit_clock_ticks();
+
+  if (tsc_end > tsc_start && ns_end > ns_start)
+  {
+    audit_clock_usec_per_tick= (ns_end - ns_start) / 1000.0 / (tsc_end - tsc_start);
+    audit_clock_tsc= true;
+  }
+#endif
+}
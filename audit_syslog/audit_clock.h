@@ -0,0 +1,43 @@
+#ifndef AUDIT_SYSLOG_CLOCK
+#define AUDIT_SYSLOG_CLOCK
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: cheap monotonic clock for timing statements.
+
+   On x86 with an invariant TSC (constant_tsc and nonstop_tsc in
+   /proc/cpuinfo) the clock is the time stamp counter, a few cycles to
+   read and the same rate on every core; audit_clock_init() measures
+   its frequency against CLOCK_MONOTONIC.  Elsewhere it is
+   CLOCK_MONOTONIC itself.
+*/
+
+#include "my_global.h"
+#include <time.h>
+
+extern bool audit_clock_tsc;
+extern double audit_clock_usec_per_tick;
+
+void audit_clock_init(void);
+
+static inline ulonglong audit_clock_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (audit_clock_tsc)
+  {
+    uint lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((ulonglong) hi << 32) | lo;
+  }
+#endif
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ulonglong) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline ulonglong audit_clock_usec(ulonglong start, ulonglong end)
+{
+  return end > start ? (ulonglong) ((end - start) * audit_clock_usec_per_tick) : 0;
+}
+
+#endif
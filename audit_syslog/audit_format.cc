@@ -0,0 +1,294 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: structured audit records, JSON lines or logfmt.
+*/
+
+#include "audit_format.h"
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+/* room kept at the end of the buffer for ,"truncated":true} */
+#define RECORD_CLOSING 32
+
+static __thread char record_buffer[AUDIT_RECORD_SIZE];
+
+/* the formatted second of the last record of this thread */
+static __thread time_t cached_second= -1;
+static __thread char cached_time[20];           /* YYYY-MM-DDTHH:MM:SS */
+
+static const char *level_names[]=
+{
+  "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug"
+};
+
+static const char hex_digits[]= "0123456789abcdef";
+
+static inline bool room(const audit_record *record, size_t length)
+{
+  return record->pos + length <= record->end;
+}
+
+static inline void put(audit_record *record, const char *data, size_t length)
+{
+  memcpy(record->pos, data, length);
+  record->pos+= length;
+}
+
+static void put_digits(char *to, uint value, uint width)
+{
+  while (width--)
+  {
+    to[width]= '0' + value % 10;
+    value/= 10;
+  }
+}
+
+/* separator and name, false once the record is full */
+static bool field_start(audit_record *record, const char *name)
+{
+  size_t name_length= strlen(name);
+
+  /* separator, name, quotes and colon, and a quote to open the value */
+  if (record->truncated || !room(record, name_length + 6))
+  {
+    record->truncated= true;
+    return false;
+  }
+  if (record->format == AUDIT_FORMAT_JSON)
+  {
+    if (record->pos[-1] != '{')
+      *record->pos++= ',';
+    *record->pos++= '"';
+    put(record, name, name_length);
+    *record->pos++= '"';
+    *record->pos++= ':';
+  }
+  else
+  {
+    if (record->pos != record_buffer)
+      *record->pos++= ' ';
+    put(record, name, name_length);
+    *record->pos++= '=';
+  }
+  return true;
+}
+
+/* length of the escaped byte in a quoted value, outside a UTF-8 sequence */
+static inline uint escaped_length(uchar c)
+{
+  if (c == '"' || c == '\\' || c == '\n' || c == '\r' || c == '\t')
+    return 2;
+  if (c < 0x20 || c >= 0x7f)
+    return 6;
+  return 1;
+}
+
+/* length of the well-formed UTF-8 sequence at s, 0 if there is none */
+static inline uint utf8_length(const uchar *s, size_t left)
+{
+  uint length;
+  ulong code;
+
+  if (s[0] < 0xc2 || s[0] > 0xf4)
+    return 0;
+  length= s[0] < 0xe0 ? 2 : s[0] < 0xf0 ? 3 : 4;
+  if (left < length)
+    return 0;
+  code= s[0] & (0x7f >> length);
+  for (uint k= 1; k < length; k++)
+  {
+    if ((s[k] & 0xc0) != 0x80)
+      return 0;
+    code= code << 6 | (s[k] & 0x3f);
+  }
+  /* overlong forms, surrogates and code points past U+10FFFF */
+  if ((length == 3 && code < 0x800) || (length == 4 && code < 0x10000) ||
+      (code >= 0xd800 && code <= 0xdfff) || code > 0x10ffff)
+    return 0;
+  return length;
+}
+
+/*
+  Well-formed UTF-8 is copied as is; a byte that is not part of it is
+  taken as Latin-1 and escaped as \u00XX, so that the record stays valid
+  UTF-8 whatever the character set of the client.
+*/
+static void put_quoted(audit_record *record, const char *value, size_t length)
+{
+  *record->pos++= '"';
+  for (size_t i= 0; i < length; i++)
+  {
+    /* copy the run of bytes that need no escaping at once */
+    size_t run= i;
+    while (run < length)
+    {
+      uchar c= (uchar) value[run];
+      uint sequence;
+      if (c < 0x80 && escaped_length(c) == 1)
+        run++;
+      else if (c >= 0x80 && (sequence= utf8_length((const uchar*) value + run, length - run)))
+        run+= sequence;
+      else
+        break;
+    }
+    if (run > i)
+    {
+      /* the closing quote always fits */
+      size_t fits= min(run - i, (size_t) (record->end - record->pos) - 1);
+      /* cut at a character boundary */
+      if (fits < run - i)
+        while (fits && ((uchar) value[i + fits] & 0xc0) == 0x80)
+          fits--;
+      put(record, value + i, fits);
+      if (fits < run - i)
+      {
+        record->truncated= true;
+        break;
+      }
+      if ((i= run) == length)
+        break;
+    }
+
+    uchar c= (uchar) value[i];
+    uint escaped= escaped_length(c);
+    if (!room(record, escaped + 1))
+    {
+      record->truncated= true;
+      break;
+    }
+    if (escaped == 2)
+    {
+      *record->pos++= '\\';
+      *record->pos++= c == '\n' ? 'n' : c == '\r' ? 'r' : c == '\t' ? 't' : c;
+    }
+    else
+    {
+      put(record, "\\u00", 4);
+      *record->pos++= hex_digits[c >> 4];
+      *record->pos++= hex_digits[c & 15];
+    }
+  }
+  *record->pos++= '"';
+}
+
+/* logfmt leaves simple ASCII values unquoted */
+static bool needs_quotes(const char *value, size_t length)
+{
+  if (!length)
+    return true;
+  for (size_t i= 0; i < length; i++)
+  {
+    uchar c= (uchar) value[i];
+    if (c <= ' ' || c == '=' || c == '"' || c == '\\' || c >= 0x7f)
+      return true;
+  }
+  return false;
+}
+
+void audit_record_str(audit_record *record, const char *name, const char *value,
+                      size_t length)
+{
+  if (!field_start(record, name))
+    return;
+  if (record->format == AUDIT_FORMAT_JSON || needs_quotes(value, length))
+    put_quoted(record, value, length);
+  else
+  {
+    size_t fits= min(length, (size_t) (record->end - record->pos));
+    put(record, value, fits);
+    if (fits < length)
+      record->truncated= true;
+  }
+}
+
+void audit_record_int(audit_record *record, const char *name, longlong value)
+{
+  char digits[24], *p= digits + sizeof(digits);
+  ulonglong magnitude= value < 0 ? 0ULL - (ulonglong) value : (ulonglong) value;
+
+  do
+  {
+    *--p= '0' + magnitude % 10;
+    magnitude/= 10;
+  } while (magnitude);
+  if (value < 0)
+    *--p= '-';
+
+  size_t length= digits + sizeof(digits) - p;
+  if (!room(record, strlen(name) + 6 + length))
+  {
+    record->truncated= true;
+    return;
+  }
+  if (field_start(record, name))
+    put(record, p, length);
+}
+
+/* ts as 2015-05-18T12:00:01.123456Z */
+static void record_timestamp(audit_record *record)
+{
+  struct timeval tv;
+  char usec[8];
+
+  gettimeofday(&tv, NULL);
+  if (tv.tv_sec != cached_second)
+  {
+    struct tm tm;
+    gmtime_r(&tv.tv_sec, &tm);
+    put_digits(cached_time, tm.tm_year + 1900, 4);
+    cached_time[4]= '-';
+    put_digits(cached_time + 5, tm.tm_mon + 1, 2);
+    cached_time[7]= '-';
+    put_digits(cached_time + 8, tm.tm_mday, 2);
+    cached_time[10]= 'T';
+    put_digits(cached_time + 11, tm.tm_hour, 2);
+    cached_time[13]= ':';
+    put_digits(cached_time + 14, tm.tm_min, 2);
+    cached_time[16]= ':';
+    put_digits(cached_time + 17, tm.tm_sec, 2);
+    cached_second= tv.tv_sec;
+  }
+
+  field_start(record, "ts");
+  if (record->format == AUDIT_FORMAT_JSON)
+    *record->pos++= '"';
+  put(record, cached_time, 19);
+  usec[0]= '.';
+  put_digits(usec + 1, (uint) tv.tv_usec, 6);
+  usec[7]= 'Z';
+  put(record, usec, 8);
+  if (record->format == AUDIT_FORMAT_JSON)
+    *record->pos++= '"';
+}
+
+void audit_record_begin(audit_record *record, uint format, const char *event, int level)
+{
+  record->pos= record_buffer;
+  record->end= record_buffer + sizeof(record_buffer) - RECORD_CLOSING;
+  record->format= format;
+  record->truncated= false;
+
+  if (format == AUDIT_FORMAT_JSON)
+    *record->pos++= '{';
+  record_timestamp(record);
+  audit_record_cstr(record, "event", event);
+  audit_record_cstr(record, "level", level_names[level & 7]);
+}
+
+const char *audit_record_end(audit_record *record)
+{
+  /* RECORD_CLOSING is kept free for this */
+  if (record->truncated)
+  {
+    if (record->format == AUDIT_FORMAT_JSON)
+      put(record, ",\"truncated\":true", 17);
+    else
+      put(record, " truncated=true", 15);
+  }
+  if (record->format == AUDIT_FORMAT_JSON)
+    *record->pos++= '}';
+  *record->pos= 0;
+  return record_buffer;
+}
@@ -0,0 +1,47 @@
+#ifndef AUDIT_SYSLOG_FORMAT
+#define AUDIT_SYSLOG_FORMAT
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: structured audit records, JSON lines or logfmt.
+
+   A record is written field by field into a buffer of the calling
+   thread, escaping as it goes; nothing is allocated and no printf-like
+   formatting is done.  Every record starts with the fields ts (UTC,
+   microseconds), event and level, the caller adds the rest:
+
+     {"ts":"2015-05-18T12:00:01.123456Z","event":"query_failed","level":"warning",...}
+     ts=2015-05-18T12:00:01.123456Z event=query_failed level=warning ...
+
+   What does not fit in the buffer is cut off, the record then ends
+   with truncated=true.
+*/
+
+#include "my_global.h"
+
+enum audit_format_type { AUDIT_FORMAT_TEXT, AUDIT_FORMAT_JSON, AUDIT_FORMAT_LOGFMT };
+
+#define AUDIT_RECORD_SIZE 8192
+
+struct audit_record
+{
+  char *pos;
+  char *end;                            /* leaves room for the closing */
+  uint format;
+  bool truncated;
+};
+
+void audit_record_begin(audit_record *record, uint format, const char *event, int level);
+void audit_record_str(audit_record *record, const char *name, const char *value, size_t length);
+void audit_record_int(audit_record *record, const char *name, longlong value);
+
+/* finishes the record, a zero-terminated line in the thread's buffer */
+const char *audit_record_end(audit_record *record);
+
+static inline void audit_record_cstr(audit_record *record, const char *name, const char *value)
+{
+  if (value)
+    audit_record_str(record, name, value, strlen(value));
+}
+
+#endif
@@ -0,0 +1,294 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: per-CPU sharded counter tables of the audit plugin.
+*/
+
+#include "audit_stats.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+  #include <sched.h>                    // sched_getcpu
+#endif
+
+/* init and free take it for writing, I_S readers for reading */
+static pthread_rwlock_t lifetime_lock= PTHREAD_RWLOCK_INITIALIZER;
+
+void audit_stats_read_lock(void)
+{
+  pthread_rwlock_rdlock(&lifetime_lock);
+}
+
+void audit_stats_read_unlock(void)
+{
+  pthread_rwlock_unlock(&lifetime_lock);
+}
+
+static uint key_hash(const char *key, uint key_length)
+{
+  ulonglong hash= 14695981039346656037ULL;
+  for (uint i= 0; i < key_length; i++)
+    hash= (hash ^ (uchar) key[i]) * 1099511628211ULL;
+  return (uint) (hash ^ (hash >> 32));
+}
+
+static inline audit_stats_row *slot(const audit_stats *stats, uchar *entries, uint i)
+{
+  return (audit_stats_row*) (entries + i * stats->entry_size);
+}
+
+/* the slot of the key in a hash of `capacity` slots, NULL if it is full */
+static audit_stats_row *lookup(const audit_stats *stats, uchar *entries,
+                               uint capacity, const char *key, uint key_length,
+                               bool *found)
+{
+  uint mask= capacity - 1;
+  uint i= key_hash(key, key_length) & mask;
+
+  for (uint probes= 0; probes < capacity; probes++, i= (i + 1) & mask)
+  {
+    audit_stats_row *row= slot(stats, entries, i);
+    if (!row->key_length)
+    {
+      *found= false;
+      return row;
+    }
+    if (row->key_length == key_length && !memcmp(row->key, key, key_length))
+    {
+      *found= true;
+      return row;
+    }
+  }
+  return NULL;
+}
+
+static void merge_counters(const audit_stats *stats, longlong *to,
+                           const longlong *from)
+{
+  for (uint c= 0; c < stats->counters; c++)
+  {
+    if (stats->max_mask & (1ULL << c))
+      to[c]= max(to[c], from[c]);
+    else
+      to[c]+= from[c];
+  }
+}
+
+/*
+   A shard entry keeps after its counters the tick of its newest slot and
+   the ring of slots, `windowed` counters each.  Merged rows hold the
+   window sums there instead.
+*/
+static inline longlong *ring(const audit_stats *stats, audit_stats_row *row)
+{
+  return row->counter + stats->counters;
+}
+
+static inline longlong *ring_slot(const audit_stats *stats, audit_stats_row *row,
+                                  longlong tick)
+{
+  return ring(stats, row) + 1 + (tick % stats->slots) * stats->windowed;
+}
+
+static inline longlong current_tick(const audit_stats *stats)
+{
+  return (longlong) time(NULL) / stats->slot_seconds;
+}
+
+/* clears the slots between the newest one of the row and `tick` */
+static void advance_window(const audit_stats *stats, audit_stats_row *row,
+                           longlong tick)
+{
+  longlong *newest= ring(stats, row);
+
+  if (tick <= *newest)
+    return;
+  if (tick - *newest >= stats->slots)
+    memset(newest + 1, 0, stats->slots * stats->windowed * sizeof(longlong));
+  else
+  {
+    for (longlong t= *newest + 1; t <= tick; t++)
+      memset(ring_slot(stats, row, t), 0, stats->windowed * sizeof(longlong));
+  }
+  *newest= tick;
+}
+
+/* adds the slots of a shard entry within the window to a merged row */
+static void merge_window(const audit_stats *stats, longlong *to,
+                         audit_stats_row *from, longlong tick)
+{
+  longlong newest= *ring(stats, from);
+
+  for (longlong t= newest; t > newest - stats->slots && t > tick - stats->slots; t--)
+  {
+    const longlong *values= ring_slot(stats, from, t);
+    for (uint w= 0; w < stats->windowed; w++)
+      to[w]+= values[w];
+  }
+}
+
+static void free_shards(audit_stats *stats)
+{
+  for (uint s= 0; s < stats->shards; s++)
+  {
+    pthread_mutex_destroy(&stats->shard[s].lock);
+    free(stats->shard[s].entries);
+  }
+  memset(stats, 0, sizeof(*stats));
+}
+
+bool audit_stats_init_windowed(audit_stats *stats, uint keys, uint counters,
+                               ulonglong max_mask, uint windowed, uint slots,
+                               uint slot_seconds)
+{
+  long cpus= sysconf(_SC_NPROCESSORS_CONF);
+  uint capacity;
+  bool error= false;
+
+  pthread_rwlock_wrlock(&lifetime_lock);
+  memset(stats, 0, sizeof(*stats));
+  if (!keys)
+    goto end;
+
+  /* at most three quarters full, probes stay short */
+  for (capacity= 16; capacity < keys + keys / 3; capacity<<= 1)
+    ;
+
+  stats->shards= (uint) min(max(cpus, 1L), (long) AUDIT_STATS_SHARDS);
+  stats->capacity= capacity;
+  stats->counters= counters;
+  stats->max_mask= max_mask;
+  if (windowed && slots && slot_seconds)
+  {
+    stats->windowed= windowed;
+    stats->slots= slots;
+    stats->slot_seconds= slot_seconds;
+    counters+= 1 + slots * windowed;
+  }
+  stats->entry_size= (offsetof(audit_stats_row, counter) +
+                      counters * sizeof(longlong) + 7) & ~(size_t) 7;
+
+  for (uint s= 0; s < stats->shards; s++)
+  {
+    audit_stats_shard *shard= &stats->shard[s];
+    pthread_mutex_init(&shard->lock, NULL);
+    /* pages are only touched once keys land on them */
+    if (!(shard->entries= (uchar*) calloc(capacity, stats->entry_size)))
+    {
+      free_shards(stats);
+      error= true;
+      goto end;
+    }
+  }
+  stats->limit= keys;
+end:
+  pthread_rwlock_unlock(&lifetime_lock);
+  return error;
+}
+
+void audit_stats_free(audit_stats *stats)
+{
+  pthread_rwlock_wrlock(&lifetime_lock);
+  free_shards(stats);
+  pthread_rwlock_unlock(&lifetime_lock);
+}
+
+static audit_stats_shard *current_shard(audit_stats *stats)
+{
+#ifdef __linux__
+  int cpu= sched_getcpu();
+  if (cpu >= 0)
+    return &stats->shard[cpu % stats->shards];
+#endif
+  return &stats->shard[(ulong) pthread_self() % stats->shards];
+}
+
+void audit_stats_add(audit_stats *stats, const char *key, uint key_length,
+                     const longlong *delta)
+{
+  audit_stats_shard *shard= current_shard(stats);
+  audit_stats_row *row;
+  bool found;
+
+  key_length= min(key_length, (uint) AUDIT_STATS_KEY_LEN);
+  pthread_mutex_lock(&shard->lock);
+  row= lookup(stats, shard->entries, stats->capacity, key, key_length, &found);
+  if (!found)
+  {
+    if (!row || shard->used >= stats->limit)
+    {
+      pthread_mutex_unlock(&shard->lock);
+      __sync_add_and_fetch(&stats->dropped, 1);
+      return;
+    }
+    memcpy(row->key, key, key_length);
+    row->key_length= key_length;
+    shard->used++;
+  }
+  merge_counters(stats, row->counter, delta);
+  if (stats->windowed)
+  {
+    longlong tick= current_tick(stats), *values;
+    advance_window(stats, row, tick);
+    values= ring_slot(stats, row, tick);
+    for (uint w= 0; w < stats->windowed; w++)
+      values[w]+= delta[stats->counters + w];
+  }
+  pthread_mutex_unlock(&shard->lock);
+}
+
+uint audit_stats_snapshot(audit_stats *stats, uchar **rows)
+{
+  uint used= 0, capacity, count= 0;
+  longlong tick= stats->windowed ? current_tick(stats) : 0;
+  uchar *merged;
+
+  *rows= NULL;
+  for (uint s= 0; s < stats->shards; s++)
+    used+= stats->shard[s].used;
+  for (capacity= 16; capacity < used * 2; capacity<<= 1)
+    ;
+  if (!(merged= (uchar*) calloc(capacity, stats->entry_size)))
+    return 0;
+
+  for (uint s= 0; s < stats->shards; s++)
+  {
+    audit_stats_shard *shard= &stats->shard[s];
+    pthread_mutex_lock(&shard->lock);
+    for (uint i= 0; i < stats->capacity; i++)
+    {
+      audit_stats_row *from= slot(stats, shard->entries, i), *to;
+      bool found;
+      if (!from->key_length)
+        continue;
+      to= lookup(stats, merged, capacity, from->key, from->key_length, &found);
+      if (!to)
+        continue;                       /* shards grew since they were counted */
+      if (!found)
+      {
+        memcpy(to->key, from->key, from->key_length);
+        to->key_length= from->key_length;
+      }
+      merge_counters(stats, to->counter, from->counter);
+      if (stats->windowed)
+        merge_window(stats, ring(stats, to), from, tick);
+    }
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  /* pack the used slots to the front */
+  for (uint i= 0; i < capacity; i++)
+  {
+    audit_stats_row *row= slot(stats, merged, i);
+    if (!row->key_length)
+      continue;
+    if (i != count)
+      memcpy(slot(stats, merged, count), row, stats->entry_size);
+    count++;
+  }
+  *rows= merged;
+  return count;
+}
@@ -0,0 +1,95 @@
+#ifndef AUDIT_SYSLOG_STATS
+#define AUDIT_SYSLOG_STATS
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: per-CPU sharded counter tables of the audit plugin.
+
+   A table maps a short binary key (schema and table, user, host...) to
+   a fixed number of counters.  Every CPU writes to its own shard, so the
+   notify path takes a lock nobody else is holding, and a reader merges
+   the shards.  Shards are preallocated open-addressing hashes: nothing
+   is allocated per event, and keys that do not fit are only counted in
+   `dropped`.
+
+   A table can also keep `windowed` counters over a sliding window of
+   `slots` slots of `slot_seconds` each: a ring per key whose stale slots
+   are cleared as time moves on.  Their deltas and merged values follow
+   the plain counters.
+
+   The tables belong to the audit plugin, their readers are the I_S
+   plugins: these hold audit_stats_read_lock() while they use a table, so
+   that uninstalling the audit plugin waits for them before freeing it.
+*/
+
+#include "my_global.h"
+#include <pthread.h>
+
+#define AUDIT_STATS_SHARDS 16
+#define AUDIT_STATS_KEY_LEN 192
+
+struct audit_stats_shard
+{
+  pthread_mutex_t lock;
+  uchar *entries;
+  uint used;
+  char pad[64];                         /* keeps neighbouring locks apart */
+};
+
+struct audit_stats
+{
+  uint shards;
+  uint capacity;                        /* slots per shard, a power of two */
+  uint limit;                           /* keys per shard */
+  uint counters;
+  ulonglong max_mask;                   /* counters merged by max, not sum */
+  uint windowed;
+  uint slots;
+  uint slot_seconds;
+  size_t entry_size;
+  volatile longlong dropped;
+  audit_stats_shard shard[AUDIT_STATS_SHARDS];
+};
+
+/* a merged entry as returned by audit_stats_snapshot() */
+struct audit_stats_row
+{
+  uint key_length;
+  char key[AUDIT_STATS_KEY_LEN];
+  longlong counter[1];                  /* counters + windowed of them */
+};
+
+bool audit_stats_init_windowed(audit_stats *stats, uint keys, uint counters,
+                               ulonglong max_mask, uint windowed, uint slots,
+                               uint slot_seconds);
+
+static inline bool audit_stats_init(audit_stats *stats, uint keys, uint counters,
+                                    ulonglong max_mask)
+{
+  return audit_stats_init_windowed(stats, keys, counters, max_mask, 0, 0, 0);
+}
+void audit_stats_free(audit_stats *stats);
+
+/* keeps every table from being set up or freed meanwhile */
+void audit_stats_read_lock(void);
+void audit_stats_read_unlock(void);
+
+static inline bool audit_stats_enabled(const audit_stats *stats)
+{
+  return stats->limit != 0;
+}
+
+/* adds delta[] to the counters of the key in the shard of this CPU */
+void audit_stats_add(audit_stats *stats, const char *key, uint key_length,
+                     const longlong *delta);
+
+/* merges all shards, *rows is to be freed with free() */
+uint audit_stats_snapshot(audit_stats *stats, uchar **rows);
+
+static inline audit_stats_row *audit_stats_row_at(const audit_stats *stats,
+                                                  uchar *rows, uint i)
+{
+  return (audit_stats_row*) (rows + i * stats->entry_size);
+}
+
+#endif
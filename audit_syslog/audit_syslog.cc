@@ -17,6 +17,9 @@
 
 #include "my_global.h"                          // 
 #include "typelib.h"                            // TYPELIB
+#include "audit_syslog.h"                       // table_access_record
+#include "audit_clock.h"                        // audit_clock_ticks
+#include "audit_format.h"                       // audit_record
 
 #if !defined(__attribute__) && (defined(__cplusplus) || !defined(__GNUC__)  || __GNUC__ == 2 && __GNUC_MINOR__ < 8)
 #define __attribute__(A)
@@ -36,16 +39,21 @@
 static volatile int total_number_of_calls;
 static volatile int number_of_calls_general;
 static volatile int number_of_calls_connection;
+static volatile int number_of_slow_statements;
 
 /* static variables for SHOW VARIABLES */
 static char *audit_host=NULL;
 static char *audit_crit_schema=NULL;
 static char *audit_ignore_username=NULL;
 static my_bool inc_log_level=0;
+static ulong slow_statement_time=0;
+static ulong audit_format=AUDIT_FORMAT_TEXT;
 
 /* thread variabes */
 static const char * log_level_names[] = {"LOG_EMERG", "LOG_ALERT", "LOG_CRIT", "LOG_ERR", "LOG_WARNING", "LOG_NOTICE", "LOG_INFO", "LOG_DEBUG"};
 static TYPELIB log_levels = { 8, NULL, log_level_names, NULL }; // need to set variables count and names only
+static const char * format_names[] = {"TEXT", "JSON", "LOGFMT"};
+static TYPELIB formats = { 3, NULL, format_names, NULL };
 
 /* function prototypes */
 static void update_log_level(MYSQL_THD thd, struct st_mysql_sys_var *var, void *tgt, const void *save);
@@ -76,6 +84,34 @@ static MYSQL_SYSVAR_BOOL(alert_all, inc_log_level,
                          PLUGIN_VAR_NOCMDARG | PLUGIN_VAR_READONLY,
                          "Log all user actions as LOG_CRIT",
                          NULL, NULL, 0);
+static MYSQL_SYSVAR_ENUM(format, audit_format,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Format of audit lines: TEXT, or JSON or LOGFMT records with named fields",
+                         NULL, NULL, AUDIT_FORMAT_TEXT, &formats);
+static MYSQL_SYSVAR_ULONG(slow_statement_time, slow_statement_time,
+                          PLUGIN_VAR_RQCMDARG,
+                          "Log statements running at least this many milliseconds as [SLOW QUERY], 0 disables",
+                          NULL, NULL, 0, 0, 24 * 3600 * 1000, 0);
+static MYSQL_SYSVAR_UINT(table_access_size, table_access_size,
+                         PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                         "Distinct tables counted in TABLE_ACCESS_STATS per CPU shard, 0 disables",
+                         NULL, NULL, 1024, 0, 1024 * 1024, 0);
+static MYSQL_SYSVAR_UINT(resource_usage_size, resource_usage_size,
+                         PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                         "Distinct user and schema pairs counted in USER_RESOURCE_USAGE per CPU shard, 0 disables",
+                         NULL, NULL, 1024, 0, 1024 * 1024, 0);
+static MYSQL_SYSVAR_UINT(resource_sample_rate, resource_sample_rate,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Measure CPU and I/O of one statement in this many for USER_RESOURCE_USAGE, 0 only counts statements",
+                         NULL, NULL, 1, 0, 1000000, 0);
+static MYSQL_SYSVAR_BOOL(resource_io, resource_io,
+                         PLUGIN_VAR_NOCMDARG,
+                         "Read /proc/thread-self/io for the bytes measured statements read and write",
+                         NULL, NULL, 0);
+static MYSQL_SYSVAR_UINT(connection_stats_size, connection_stats_size,
+                         PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                         "Distinct user and host pairs counted in CONNECTION_STATS per CPU shard, 0 disables",
+                         NULL, NULL, 1024, 0, 1024 * 1024, 0);
 /*
    Plugin local variables for SHOW VARIABLES
 */
@@ -90,6 +126,13 @@ static struct st_mysql_sys_var* audit_syslog_sysvars[] = {
     MYSQL_SYSVAR(ignore_username),
     MYSQL_SYSVAR(log_level),
     MYSQL_SYSVAR(alert_all),
+    MYSQL_SYSVAR(format),
+    MYSQL_SYSVAR(slow_statement_time),
+    MYSQL_SYSVAR(table_access_size),
+    MYSQL_SYSVAR(resource_usage_size),
+    MYSQL_SYSVAR(resource_sample_rate),
+    MYSQL_SYSVAR(resource_io),
+    MYSQL_SYSVAR(connection_stats_size),
     NULL
 };
 
@@ -104,7 +147,20 @@ static void update_log_level(MYSQL_THD thd, struct st_mysql_sys_var *var,
   if (    sctx->host_or_ip && sctx->user
        && strcasestr(sctx->host_or_ip, audit_host) != NULL
        && strcasestr(sctx->user, audit_ignore_username) == NULL)
-    syslog(inc_log_level ? LOG_CRIT : LOG_WARNING,"[LOG LEVEL CHANGED] host:%s user:%s \n", sctx->host_or_ip, sctx->user);
+  {
+    int level = inc_log_level ? LOG_CRIT : LOG_WARNING;
+    if (audit_format == AUDIT_FORMAT_TEXT)
+      syslog(level,"[LOG LEVEL CHANGED] host:%s user:%s \n", sctx->host_or_ip, sctx->user);
+    else
+    {
+      audit_record record;
+      audit_record_begin(&record, audit_format, "log_level_changed", level);
+      audit_record_cstr(&record, "user", sctx->user);
+      audit_record_cstr(&record, "host", sctx->host_or_ip);
+      audit_record_cstr(&record, "log_level", log_level_names[*(long *) save & 7]);
+      syslog(level, "%s", audit_record_end(&record));
+    }
+  }
 }
 
 /*
@@ -121,6 +177,21 @@ static int audit_syslog_init(void *arg __attribute__((unused)))
     total_number_of_calls      = 0;
     number_of_calls_general    = 0;
     number_of_calls_connection = 0;
+    number_of_slow_statements  = 0;
+    audit_clock_init();
+    if (table_access_start())
+      return(1);
+    if (resource_usage_start())
+    {
+      table_access_stop();
+      return(1);
+    }
+    if (connection_stats_start())
+    {
+      resource_usage_stop();
+      table_access_stop();
+      return(1);
+    }
     return(0);
 }
 
@@ -130,6 +201,9 @@ static int audit_syslog_init(void *arg __attribute__((unused)))
 static int audit_syslog_deinit(void *arg __attribute__((unused)))
 {
     closelog();
+    table_access_stop();
+    resource_usage_stop();
+    connection_stats_stop();
     return(0);
 }
 
@@ -284,6 +358,117 @@ static bool check_crit_schema(MYSQL_THD thd)
   return false;
 }
 
+/*
+   Structured records of statements and connections
+*/
+static void record_session(audit_record *record, MYSQL_THD thd)
+{
+  const Security_context *sctx = &thd->main_security_ctx;
+
+  audit_record_cstr(record, "user", sctx->user);
+  audit_record_cstr(record, "host", sctx->host_or_ip);
+#if MYSQL_VERSION_ID > 50600
+  audit_record_cstr(record, "ip", ((Security_context *) sctx)->get_ip()->c_ptr_safe());
+#else
+  audit_record_cstr(record, "ip", sctx->ip);
+#endif
+  if (thd->db)
+    audit_record_str(record, "db", thd->db, thd->db_length);
+}
+
+// rows and duration_usec are left out when negative
+static void log_statement_record(int level, const char *name, MYSQL_THD thd,
+                                 const struct mysql_event_general *event_general,
+                                 longlong rows, longlong duration_usec)
+{
+  audit_record record;
+
+  audit_record_begin(&record, audit_format, name, level);
+  audit_record_int(&record, "thread_id", event_general->general_thread_id);
+  record_session(&record, thd);
+  if (event_general->general_command)
+    audit_record_str(&record, "command", event_general->general_command,
+                     event_general->general_command_length);
+  audit_record_int(&record, "error_code", event_general->general_error_code);
+  if (rows >= 0)
+    audit_record_int(&record, "rows", rows);
+  if (duration_usec >= 0)
+    audit_record_int(&record, "duration_usec", duration_usec);
+  // last and whole: a long query is cut by the record, with truncated=true
+  if (event_general->general_query)
+    audit_record_str(&record, "query", event_general->general_query,
+                     event_general->general_query_length);
+  syslog(level, "%s", audit_record_end(&record));
+}
+
+static void log_connection_record(int level, const char *name,
+                                  const struct mysql_event_connection *event_connection)
+{
+  audit_record record;
+
+  audit_record_begin(&record, audit_format, name, level);
+  audit_record_int(&record, "thread_id", event_connection->thread_id);
+  audit_record_str(&record, "user", event_connection->user, event_connection->user_length);
+  audit_record_str(&record, "host", event_connection->host, event_connection->host_length);
+  if (event_connection->ip)
+    audit_record_str(&record, "ip", event_connection->ip, event_connection->ip_length);
+  if (event_connection->database)
+    audit_record_str(&record, "db", event_connection->database, event_connection->database_length);
+  audit_record_int(&record, "status", event_connection->status);
+  syslog(level, "%s", audit_record_end(&record));
+}
+
+/*
+   Slow statements: the LOG event of a statement and its STATUS event
+   are sent from the thread that runs it, so the start is kept per thread.
+   Both come once per command, so a COM_QUERY of several statements is
+   timed as a whole; the statements get query ids of their own in between,
+   which is why the start is matched by THD only.
+*/
+struct statement_start
+{
+  MYSQL_THD thd;
+  ulonglong ticks;
+};
+
+static __thread statement_start current_statement;
+
+static void slow_statement_start(MYSQL_THD thd)
+{
+  current_statement.thd = thd;
+  current_statement.ticks = audit_clock_ticks();
+}
+
+// duration of a slow statement, -1 if it was fast or its start was missed
+static longlong slow_statement_end(MYSQL_THD thd)
+{
+  if (current_statement.thd != thd)
+    return -1;
+  current_statement.thd = NULL;
+
+  ulonglong usec = audit_clock_usec(current_statement.ticks, audit_clock_ticks());
+  if (usec < (ulonglong) slow_statement_time * 1000)
+    return -1;
+  number_of_slow_statements++;
+  return (longlong) usec;
+}
+
+static void log_slow_statement(MYSQL_THD thd, const struct mysql_event_general *event_general,
+                               ulonglong usec, const char *strip_command, const char *strip_query)
+{
+  // affected rows for DML, rows of the result set otherwise
+  longlong rows = thd->get_row_count_func();
+  if (rows < 0)
+    rows = (longlong) event_general->general_rows;
+
+  if (audit_format == AUDIT_FORMAT_TEXT)
+    syslog(LOG_WARNING,"[SLOW QUERY] %lu: User: %s  Duration: %llu.%06llu  Rows: %lld  Command: %s  Query: %s Error Code: %d\n",
+           event_general->general_thread_id, event_general->general_user, usec / 1000000, usec % 1000000,
+           rows, strip_command, strip_query, event_general->general_error_code);
+  else
+    log_statement_record(LOG_WARNING, "slow_query", thd, event_general, rows, usec);
+}
+
 static void audit_syslog_notify(MYSQL_THD thd, unsigned int event_class, const void *event)
 {
   total_number_of_calls++;
@@ -298,6 +483,22 @@ static void audit_syslog_notify(MYSQL_THD thd, unsigned int event_class, const v
     if (event_class == MYSQL_AUDIT_GENERAL_CLASS)         
     {
       const struct mysql_event_general *event_general = (const struct mysql_event_general *) event;
+      longlong slow_usec = -1;
+
+      // statistics and timing cover every statement, logged or not
+      if (event_general && event_general->event_subclass == MYSQL_AUDIT_GENERAL_LOG)
+      {
+        resource_usage_statement_start(thd);
+        if (slow_statement_time)
+          slow_statement_start(thd);
+      }
+      else if (event_general && event_general->event_subclass == MYSQL_AUDIT_GENERAL_STATUS)
+      {
+        table_access_record(thd, event_general);
+        resource_usage_statement_end(thd);
+        if (slow_statement_time)
+          slow_usec = slow_statement_end(thd);
+      }
 
       if (  event_general
          && event_general->general_user
@@ -308,8 +509,12 @@ static void audit_syslog_notify(MYSQL_THD thd, unsigned int event_class, const v
       {
         char strip_query[MAX_SYSLOG_LEN];
         char strip_command[MAX_SYSLOG_LEN];
-        syslog_strip_string(strip_query, event_general->general_query, event_general->general_query_length);
-        syslog_strip_string(strip_command, event_general->general_command, event_general->general_command_length);        
+        bool text = audit_format == AUDIT_FORMAT_TEXT;
+        if (text)  // records escape the query instead
+        {
+          syslog_strip_string(strip_query, event_general->general_query, event_general->general_query_length);
+          syslog_strip_string(strip_command, event_general->general_command, event_general->general_command_length);
+        }
         
         int current_log_level = THDVAR(thd, log_level);
         int notify_level;
@@ -325,17 +530,21 @@ static void audit_syslog_notify(MYSQL_THD thd, unsigned int event_class, const v
         case MYSQL_AUDIT_GENERAL_ERROR: // ERROR events occur before transmitting errors to the user.
           notify_level = (inc_log_level || check_crit_schema(thd) ? LOG_CRIT : LOG_WARNING);
 
-          if (current_log_level >= notify_level)
+          if (current_log_level >= notify_level && text)
               syslog(notify_level,"[QUERY FAILED] %lu: User: %s  Command: %s  Query: %s\n",
                      event_general->general_thread_id, event_general->general_user, strip_command, strip_query); 
+          else if (current_log_level >= notify_level)
+              log_statement_record(notify_level, "query_failed", thd, event_general, -1, -1);
           break;
         case MYSQL_AUDIT_GENERAL_RESULT: // RESULT events occur after transmitting a resultset to the user.
           notify_level = (inc_log_level || check_crit_schema(thd) ? LOG_CRIT : LOG_NOTICE);
 
-          if (current_log_level >= notify_level && !verified_schemas_only)
+          if (current_log_level >= notify_level && !verified_schemas_only && text)
               syslog(notify_level,
                      "[QUERY SUCCEEDED] %lu: User: %s  Command: %s  Query: %s\n",
                      event_general->general_thread_id, event_general->general_user, strip_command, strip_query);
+          else if (current_log_level >= notify_level && !verified_schemas_only)
+              log_statement_record(notify_level, "query_succeeded", thd, event_general, -1, -1);
           break;
         case MYSQL_AUDIT_GENERAL_STATUS: // STATUS events occur after transmitting a resultset or errors
           notify_level = (inc_log_level || check_crit_schema(thd) ? LOG_CRIT : LOG_NOTICE);
@@ -343,8 +552,17 @@ static void audit_syslog_notify(MYSQL_THD thd, unsigned int event_class, const v
           if (    current_log_level >= notify_level
                && (!verified_schemas_only || NVL(event_general->general_error_code, 0) != 0)
             )
+          {
+            if (text)
               syslog(notify_level,"[QUERY DETAILS] %lu: User: %s  Command: %s  Query: %s Error Code: %d\n",
                      event_general->general_thread_id, event_general->general_user, strip_command, strip_query, event_general->general_error_code);
+            else
+              log_statement_record(notify_level, "query_details", thd, event_general,
+                                   (longlong) event_general->general_rows, -1);
+          }
+
+          if (slow_usec >= 0 && current_log_level >= LOG_WARNING)
+            log_slow_statement(thd, event_general, slow_usec, strip_command, strip_query);
           break;
         default:
           break;
@@ -354,6 +572,9 @@ static void audit_syslog_notify(MYSQL_THD thd, unsigned int event_class, const v
     else if (event_class == MYSQL_AUDIT_CONNECTION_CLASS)
     {
       const struct mysql_event_connection *event_connection = (const struct mysql_event_connection *) event;
+      // counted before the filters, churn of ignored users is still churn
+      if (event_connection)
+        connection_stats_record(thd, event_connection);
       if (   event_connection
           && event_connection->host
           && NVL(event_connection->host_length, 0) > 0
@@ -374,11 +595,16 @@ static void audit_syslog_notify(MYSQL_THD thd, unsigned int event_class, const v
 
             if (    current_log_level >= notify_level 
                  && (!verified_schemas_only || NVL(event_connection->status, 0) != 0)
+                 && audit_format == AUDIT_FORMAT_TEXT
                 )
                 syslog(notify_level,
                        "[CONNECT] %lu: User: %s@%s[%s]  Event: %d  Status: %d\n",
                        event_connection->thread_id, event_connection->user, event_connection->host,
                        event_connection->ip, event_connection->event_subclass, event_connection->status );
+            else if (    current_log_level >= notify_level
+                      && (!verified_schemas_only || NVL(event_connection->status, 0) != 0)
+                    )
+                log_connection_record(notify_level, "connect", event_connection);
             break;
           case MYSQL_AUDIT_CONNECTION_DISCONNECT: // DISCONNECT occurs after connection is terminated.
             break;
@@ -387,11 +613,16 @@ static void audit_syslog_notify(MYSQL_THD thd, unsigned int event_class, const v
             
             if (    current_log_level >= notify_level 
                  && (!verified_schemas_only || NVL(event_connection->status, 0) != 0)
+                 && audit_format == AUDIT_FORMAT_TEXT
                 )
                 syslog(notify_level,
                        "[CHANGE USER] %lu: User: %s@%s[%s]  Event: %d  Status: %d\n",
                        event_connection->thread_id, event_connection->user, event_connection->host,
                        event_connection->ip, event_connection->event_subclass, event_connection->status);
+            else if (    current_log_level >= notify_level
+                      && (!verified_schemas_only || NVL(event_connection->status, 0) != 0)
+                    )
+                log_connection_record(notify_level, "change_user", event_connection);
             break;
           default:
             break;
@@ -420,12 +651,21 @@ static struct st_mysql_audit audit_syslog_descriptor=
 */
 static struct st_mysql_show_var audit_syslog_status[]=
 {
-  { "Audit_syslog_total_calls",       (char *) &total_number_of_calls,      SHOW_INT },
-  { "Audit_syslog_general_events",    (char *) &number_of_calls_general,    SHOW_INT },
-  { "Audit_syslog_connection_events", (char *) &number_of_calls_connection, SHOW_INT },
+  { "Audit_syslog_total_calls",              (char *) &total_number_of_calls,      SHOW_INT },
+  { "Audit_syslog_general_events",           (char *) &number_of_calls_general,    SHOW_INT },
+  { "Audit_syslog_connection_events",        (char *) &number_of_calls_connection, SHOW_INT },
+  { "Audit_syslog_slow_statements",          (char *) &number_of_slow_statements,  SHOW_INT },
+  { "Audit_syslog_table_access_dropped",     (char *) &table_access.dropped,       SHOW_LONGLONG },
+  { "Audit_syslog_resource_usage_dropped",   (char *) &resource_usage.dropped,     SHOW_LONGLONG },
+  { "Audit_syslog_connection_stats_dropped", (char *) &connection_stats.dropped,   SHOW_LONGLONG },
   { 0, 0, SHOW_INT }
 };
 
+static struct st_mysql_information_schema audit_syslog_is_descriptor=
+{
+  MYSQL_INFORMATION_SCHEMA_INTERFACE_VERSION
+};
+
 /*
   Plugin library descriptor
 */
@@ -439,11 +679,56 @@ mysql_declare_plugin(audit_syslog)
   PLUGIN_LICENSE_GPL,
   audit_syslog_init,          /* init function (when loaded)     */
   audit_syslog_deinit,        /* deinit function (when unloaded) */
-  0x0003,                     /* version                         */
+  0x0008,                     /* version                         */
   audit_syslog_status,        /* status variables                */
   audit_syslog_sysvars,       /* system variables                */
   NULL,
   0,
+},
+{
+  MYSQL_INFORMATION_SCHEMA_PLUGIN,  /* type                            */
+  &audit_syslog_is_descriptor,      /* descriptor                      */
+  "TABLE_ACCESS_STATS",             /* name                            */
+  "PaynetEasy",                     /* author                          */
+  "Reads, writes, rows and errors per table seen by audit_syslog",
+  PLUGIN_LICENSE_GPL,
+  table_access_stats_init,          /* init function (when loaded)     */
+  NULL,                             /* deinit function (when unloaded) */
+  0x0100,                           /* version                         */
+  NULL,                             /* status variables                */
+  NULL,                             /* system variables                */
+  NULL,
+  0,
+},
+{
+  MYSQL_INFORMATION_SCHEMA_PLUGIN,  /* type                            */
+  &audit_syslog_is_descriptor,      /* descriptor                      */
+  "USER_RESOURCE_USAGE",            /* name                            */
+  "PaynetEasy",                     /* author                          */
+  "CPU and I/O of statements by user and schema seen by audit_syslog",
+  PLUGIN_LICENSE_GPL,
+  user_resource_usage_init,         /* init function (when loaded)     */
+  NULL,                             /* deinit function (when unloaded) */
+  0x0100,                           /* version                         */
+  NULL,                             /* status variables                */
+  NULL,                             /* system variables                */
+  NULL,
+  0,
+},
+{
+  MYSQL_INFORMATION_SCHEMA_PLUGIN,  /* type                            */
+  &audit_syslog_is_descriptor,      /* descriptor                      */
+  "CONNECTION_STATS",               /* name                            */
+  "PaynetEasy",                     /* author                          */
+  "Connects, failures and session durations by user and host seen by audit_syslog",
+  PLUGIN_LICENSE_GPL,
+  connection_stats_init,            /* init function (when loaded)     */
+  NULL,                             /* deinit function (when unloaded) */
+  0x0100,                           /* version                         */
+  NULL,                             /* status variables                */
+  NULL,                             /* system variables                */
+  NULL,
+  0,
 }
 mysql_declare_plugin_end;
 
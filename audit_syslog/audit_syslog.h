@@ -0,0 +1,45 @@
+#ifndef AUDIT_SYSLOG_H
+#define AUDIT_SYSLOG_H
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: declarations shared by the files of the audit plugin.
+*/
+
+#include <mysql/plugin.h>
+#include "audit_stats.h"
+
+struct mysql_event_general;
+struct mysql_event_connection;
+
+/* table_access.cc */
+extern uint table_access_size;
+extern audit_stats table_access;
+
+bool table_access_start(void);
+void table_access_stop(void);
+void table_access_record(MYSQL_THD thd, const struct mysql_event_general *event);
+int table_access_stats_init(void *p);
+
+/* resource_usage.cc */
+extern uint resource_usage_size;
+extern uint resource_sample_rate;
+extern my_bool resource_io;
+extern audit_stats resource_usage;
+
+bool resource_usage_start(void);
+void resource_usage_stop(void);
+void resource_usage_statement_start(MYSQL_THD thd);
+void resource_usage_statement_end(MYSQL_THD thd);
+int user_resource_usage_init(void *p);
+
+/* connection_stats.cc */
+extern uint connection_stats_size;
+extern audit_stats connection_stats;
+
+bool connection_stats_start(void);
+void connection_stats_stop(void);
+void connection_stats_record(MYSQL_THD thd, const struct mysql_event_connection *event);
+int connection_stats_init(void *p);
+
+#endif
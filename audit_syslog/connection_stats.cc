@@ -0,0 +1,184 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: connection lifecycle counters of the audit plugin,
+                INFORMATION_SCHEMA.CONNECTION_STATS.
+
+   Every CONNECT, CHANGE_USER and DISCONNECT event is counted for its
+   user and host, whatever the log filters say, so that clients which
+   keep reconnecting instead of reusing their connections stand out.
+   Connects and failed connects are also kept over the last minute, in
+   slots of CONNECTION_SLOT_SECONDS, and every ended session goes to a
+   histogram of its duration, from thr_create_utime to DISCONNECT.
+*/
+#define MYSQL_SERVER
+
+#include <my_pthread.h>
+#include <sql_priv.h>
+#include <mysql/plugin.h>
+#include <sql_class.h>
+#include <mysql/plugin_audit.h>
+
+#include "my_global.h"
+#include "audit_syslog.h"
+
+bool schema_table_store_record(THD *thd, TABLE *table);
+
+enum connection_counter
+{
+  CS_CONNECTS, CS_FAILED_CONNECTS, CS_CHANGE_USERS, CS_DISCONNECTS,
+  CS_SESSION_USEC, CS_MAX_SESSION_USEC,
+  CS_SESSIONS_10MS, CS_SESSIONS_100MS, CS_SESSIONS_1S, CS_SESSIONS_10S,
+  CS_SESSIONS_1MIN, CS_SESSIONS_10MIN, CS_SESSIONS_1H, CS_SESSIONS_LONGER,
+  CS_COUNTERS,
+  /* windowed, after the counters */
+  CS_CONNECTS_LAST_MINUTE= CS_COUNTERS, CS_FAILED_CONNECTS_LAST_MINUTE,
+  CS_ALL
+};
+
+#define CONNECTION_WINDOWED (CS_ALL - CS_COUNTERS)
+#define CONNECTION_SLOT_SECONDS 5
+#define CONNECTION_SLOTS (60 / CONNECTION_SLOT_SECONDS)
+
+/* upper bounds of the session histogram, the last bucket takes the rest */
+static const ulonglong session_bounds_usec[]=
+{
+  10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+  60000000ULL, 600000000ULL, 3600000000ULL
+};
+
+uint connection_stats_size;
+audit_stats connection_stats;
+
+ST_FIELD_INFO connection_stats_fields[]=
+{
+  {"USER", USERNAME_CHAR_LENGTH, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"HOST", HOSTNAME_LENGTH, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"CONNECTS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"FAILED_CONNECTS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"CHANGE_USERS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"DISCONNECTS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"SESSION_USEC", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"MAX_SESSION_USEC", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"SESSIONS_10MS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"SESSIONS_100MS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"SESSIONS_1S", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"SESSIONS_10S", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"SESSIONS_1MIN", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"SESSIONS_10MIN", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"SESSIONS_1H", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"SESSIONS_LONGER", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"CONNECTS_LAST_MINUTE", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"FAILED_CONNECTS_LAST_MINUTE", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {0, 0, MYSQL_TYPE_NULL, 0, 0, 0, 0}
+};
+
+bool connection_stats_start(void)
+{
+  return audit_stats_init_windowed(&connection_stats, connection_stats_size,
+                                   CS_COUNTERS, 1ULL << CS_MAX_SESSION_USEC,
+                                   CONNECTION_WINDOWED, CONNECTION_SLOTS,
+                                   CONNECTION_SLOT_SECONDS);
+}
+
+void connection_stats_stop(void)
+{
+  audit_stats_free(&connection_stats);
+}
+
+static uint session_bucket(ulonglong usec)
+{
+  uint b= 0;
+  while (b < array_elements(session_bounds_usec) && usec >= session_bounds_usec[b])
+    b++;
+  return CS_SESSIONS_10MS + b;
+}
+
+void connection_stats_record(MYSQL_THD thd, const struct mysql_event_connection *event)
+{
+  longlong delta[CS_ALL]= { 0 };
+  char key[AUDIT_STATS_KEY_LEN];
+  const char *host;
+  uint user_length, host_length;
+
+  if (!audit_stats_enabled(&connection_stats))
+    return;
+
+  switch (event->event_subclass)
+  {
+  case MYSQL_AUDIT_CONNECTION_CONNECT:
+    delta[CS_CONNECTS]= delta[CS_CONNECTS_LAST_MINUTE]= 1;
+    if (event->status)
+      delta[CS_FAILED_CONNECTS]= delta[CS_FAILED_CONNECTS_LAST_MINUTE]= 1;
+    break;
+  case MYSQL_AUDIT_CONNECTION_CHANGE_USER:
+    delta[CS_CHANGE_USERS]= 1;
+    break;
+  case MYSQL_AUDIT_CONNECTION_DISCONNECT:
+  {
+    ulonglong now= my_micro_time(), started= thd->thr_create_utime;
+    ulonglong usec= started && now > started ? now - started : 0;
+    delta[CS_DISCONNECTS]= 1;
+    delta[CS_SESSION_USEC]= delta[CS_MAX_SESSION_USEC]= usec;
+    delta[session_bucket(usec)]= 1;
+    break;
+  }
+  default:
+    return;
+  }
+
+  /* user and host separated by a zero byte, the ip if there is no host */
+  host= event->host_length ? event->host : event->ip;
+  host_length= event->host_length ? event->host_length : event->ip_length;
+  user_length= event->user ? min(event->user_length, (uint) USERNAME_LENGTH) : 0;
+  host_length= host ? min(host_length, (uint) HOSTNAME_LENGTH) : 0;
+  if (user_length + 1 + host_length > sizeof(key))
+    return;
+  if (user_length)
+    memcpy(key, event->user, user_length);
+  key[user_length]= 0;
+  if (host_length)
+    memcpy(key + user_length + 1, host, host_length);
+  audit_stats_add(&connection_stats, key, user_length + 1 + host_length, delta);
+}
+
+#if MYSQL_VERSION_ID > 50600
+static int fill_connection_stats(THD *thd, TABLE_LIST *tables, Item *item)
+#else
+static int fill_connection_stats(THD *thd, TABLE_LIST *tables, COND *cond)
+#endif
+{
+  TABLE *table= tables->table;
+  CHARSET_INFO *cs= system_charset_info;
+  uchar *rows= NULL;
+  uint count= 0;
+  int error= 0;
+
+  /* the audit plugin cannot free the table while it is read */
+  audit_stats_read_lock();
+  if (audit_stats_enabled(&connection_stats))
+    count= audit_stats_snapshot(&connection_stats, &rows);
+  for (uint i= 0; i < count && !error; i++)
+  {
+    audit_stats_row *row= audit_stats_row_at(&connection_stats, rows, i);
+    uint user_length= strlen(row->key);
+
+    table->field[0]->store(row->key, user_length, cs);
+    table->field[1]->store(row->key + user_length + 1,
+                           row->key_length - user_length - 1, cs);
+    for (uint c= 0; c < CS_ALL; c++)
+      table->field[2 + c]->store(row->counter[c], 1);
+    error= schema_table_store_record(thd, table);
+  }
+  free(rows);
+  audit_stats_read_unlock();
+  return error;
+}
+
+int connection_stats_init(void *p)
+{
+  ST_SCHEMA_TABLE *schema= (ST_SCHEMA_TABLE*) p;
+  schema->fields_info= connection_stats_fields;
+  schema->fill_table= fill_connection_stats;
+  return 0;
+}
@@ -0,0 +1,232 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: CPU and I/O of statements charged to their user and
+                schema, INFORMATION_SCHEMA.USER_RESOURCE_USAGE.
+
+   A statement runs on one thread from its LOG to its STATUS event, so
+   the thread's own counters, getrusage(RUSAGE_THREAD) and optionally
+   /proc/thread-self/io, taken at both events give what the statement
+   cost.  The difference is added to the counters of the user and the
+   current schema.
+
+   Only one statement in audit_syslog_resource_sample_rate is measured,
+   every statement is counted, even with the rate at 0; CPU and I/O of
+   the user and schema are then about STATEMENTS / SAMPLED times the
+   measured values.  LOG and STATUS come once per command, so the
+   statements of a multi-statement COM_QUERY are measured together.
+*/
+#define MYSQL_SERVER
+
+#include <my_pthread.h>
+#include <sql_priv.h>
+#include <mysql/plugin.h>
+#include <sql_class.h>
+#include <mysql/plugin_audit.h>
+
+#include "my_global.h"
+#include "audit_syslog.h"
+#include "../sys_usage/proc_io.h"               // read_proc_io
+
+#include <stdio.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+bool schema_table_store_record(THD *thd, TABLE *table);
+
+enum resource_counter
+{
+  RU_STATEMENTS, RU_SAMPLED,
+  RU_CPU_USER_USEC, RU_CPU_SYS_USEC,
+  RU_BLOCK_READS, RU_BLOCK_WRITES,
+  RU_READ_BYTES, RU_WRITE_BYTES,
+  RU_VOLUNTARY_SWITCHES, RU_INVOLUNTARY_SWITCHES,
+  RU_COUNTERS
+};
+
+uint resource_usage_size;
+uint resource_sample_rate;
+my_bool resource_io;
+audit_stats resource_usage;
+
+ST_FIELD_INFO user_resource_usage_fields[]=
+{
+  {"USER", USERNAME_CHAR_LENGTH, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"SCHEMA_NAME", NAME_LEN, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"STATEMENTS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"SAMPLED", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"CPU_USER_USEC", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"CPU_SYS_USEC", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"BLOCK_READS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"BLOCK_WRITES", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"READ_BYTES", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"WRITE_BYTES", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"VOLUNTARY_SWITCHES", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"INVOLUNTARY_SWITCHES", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {0, 0, MYSQL_TYPE_NULL, 0, 0, 0, 0}
+};
+
+/* counters of the thread at the LOG event of its current statement */
+struct resource_sample
+{
+  MYSQL_THD thd;
+  uint countdown;
+  bool io;
+  struct rusage usage;
+  proc_io io_counters;
+};
+
+static __thread resource_sample thread_sample;
+
+bool resource_usage_start(void)
+{
+  return audit_stats_init(&resource_usage, resource_usage_size, RU_COUNTERS, 0);
+}
+
+void resource_usage_stop(void)
+{
+  audit_stats_free(&resource_usage);
+}
+
+static bool read_thread_io(proc_io *io)
+{
+#ifdef __linux__
+  /* /proc/thread-self appeared in Linux 3.17 */
+  static bool no_thread_self;
+  if (!no_thread_self)
+  {
+    if (!read_proc_io("/proc/thread-self/io", io))
+      return false;
+    no_thread_self= true;
+  }
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/self/task/%ld/io", (long) syscall(SYS_gettid));
+  return read_proc_io(path, io);
+#else
+  return true;
+#endif
+}
+
+static bool read_thread_usage(struct rusage *usage)
+{
+#ifdef RUSAGE_THREAD
+  return getrusage(RUSAGE_THREAD, usage) != 0;
+#else
+  return true;
+#endif
+}
+
+static longlong usec_between(const struct timeval &from, const struct timeval &to)
+{
+  return (longlong) (to.tv_sec - from.tv_sec) * 1000000 + (to.tv_usec - from.tv_usec);
+}
+
+void resource_usage_statement_start(MYSQL_THD thd)
+{
+  resource_sample *sample= &thread_sample;
+
+  sample->thd= NULL;
+  if (!audit_stats_enabled(&resource_usage) || !resource_sample_rate)
+    return;
+  if (sample->countdown > 1)
+  {
+    sample->countdown--;
+    return;
+  }
+  sample->countdown= resource_sample_rate;
+
+  if (read_thread_usage(&sample->usage))
+    return;
+  sample->io= resource_io && !read_thread_io(&sample->io_counters);
+  sample->thd= thd;
+}
+
+void resource_usage_statement_end(MYSQL_THD thd)
+{
+  resource_sample *sample= &thread_sample;
+  longlong delta[RU_COUNTERS]= { 0 };
+  char key[AUDIT_STATS_KEY_LEN];
+  const char *user= thd->main_security_ctx.user;
+  uint user_length, db_length;
+
+  if (!audit_stats_enabled(&resource_usage))
+    return;
+
+  delta[RU_STATEMENTS]= 1;
+  if (sample->thd == thd)
+  {
+    struct rusage usage;
+    proc_io io;
+
+    if (!read_thread_usage(&usage))
+    {
+      delta[RU_SAMPLED]= 1;
+      delta[RU_CPU_USER_USEC]= usec_between(sample->usage.ru_utime, usage.ru_utime);
+      delta[RU_CPU_SYS_USEC]= usec_between(sample->usage.ru_stime, usage.ru_stime);
+      delta[RU_BLOCK_READS]= usage.ru_inblock - sample->usage.ru_inblock;
+      delta[RU_BLOCK_WRITES]= usage.ru_oublock - sample->usage.ru_oublock;
+      delta[RU_VOLUNTARY_SWITCHES]= usage.ru_nvcsw - sample->usage.ru_nvcsw;
+      delta[RU_INVOLUNTARY_SWITCHES]= usage.ru_nivcsw - sample->usage.ru_nivcsw;
+    }
+    if (delta[RU_SAMPLED] && sample->io && !read_thread_io(&io))
+    {
+      delta[RU_READ_BYTES]= io.read_bytes - sample->io_counters.read_bytes;
+      delta[RU_WRITE_BYTES]= io.write_bytes - sample->io_counters.write_bytes;
+    }
+  }
+  sample->thd= NULL;
+
+  /* user and schema separated by a zero byte */
+  user= user ? user : "";
+  user_length= min(strlen(user), (size_t) USERNAME_LENGTH);
+  db_length= thd->db ? min(thd->db_length, (uint) NAME_LEN) : 0;
+  if (user_length + 1 + db_length > sizeof(key))
+    return;
+  memcpy(key, user, user_length);
+  key[user_length]= 0;
+  if (db_length)
+    memcpy(key + user_length + 1, thd->db, db_length);
+  audit_stats_add(&resource_usage, key, user_length + 1 + db_length, delta);
+}
+
+#if MYSQL_VERSION_ID > 50600
+static int fill_user_resource_usage(THD *thd, TABLE_LIST *tables, Item *item)
+#else
+static int fill_user_resource_usage(THD *thd, TABLE_LIST *tables, COND *cond)
+#endif
+{
+  TABLE *table= tables->table;
+  CHARSET_INFO *cs= system_charset_info;
+  uchar *rows= NULL;
+  uint count= 0;
+  int error= 0;
+
+  /* the audit plugin cannot free the table while it is read */
+  audit_stats_read_lock();
+  if (audit_stats_enabled(&resource_usage))
+    count= audit_stats_snapshot(&resource_usage, &rows);
+  for (uint i= 0; i < count && !error; i++)
+  {
+    audit_stats_row *row= audit_stats_row_at(&resource_usage, rows, i);
+    uint user_length= strlen(row->key);
+
+    table->field[0]->store(row->key, user_length, cs);
+    table->field[1]->store(row->key + user_length + 1,
+                           row->key_length - user_length - 1, cs);
+    for (uint c= 0; c < RU_COUNTERS; c++)
+      table->field[2 + c]->store(row->counter[c], 1);
+    error= schema_table_store_record(thd, table);
+  }
+  free(rows);
+  audit_stats_read_unlock();
+  return error;
+}
+
+int user_resource_usage_init(void *p)
+{
+  ST_SCHEMA_TABLE *schema= (ST_SCHEMA_TABLE*) p;
+  schema->fields_info= user_resource_usage_fields;
+  schema->fill_table= fill_user_resource_usage;
+  return 0;
+}
@@ -0,0 +1,168 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: per-table access counters of the audit plugin,
+                INFORMATION_SCHEMA.TABLE_ACCESS_STATS.
+
+   At the STATUS event of every statement the tables it opened are
+   walked, as verify_schemas_owner() does, and each one is charged with
+   a read or a write, depending on the lock the statement took on it,
+   and with the statement type, rows and error.
+
+   The server counts rows per statement, not per table: RESULT_ROWS is
+   the size of the result set sent to the client and ROWS_CHANGED the
+   affected rows, and a join or a multi-table UPDATE charges the whole
+   count to every table it names.
+*/
+#define MYSQL_SERVER
+
+#include <my_pthread.h>
+#include <sql_priv.h>
+#include <mysql/plugin.h>
+#include <sql_class.h>
+#include <mysql/plugin_audit.h>
+
+#include "my_global.h"
+#include "audit_syslog.h"
+
+bool schema_table_store_record(THD *thd, TABLE *table);
+
+enum table_access_counter
+{
+  TA_READS, TA_WRITES,
+  TA_SELECTS, TA_INSERTS, TA_UPDATES, TA_DELETES, TA_OTHERS,
+  TA_RESULT_ROWS, TA_ROWS_CHANGED, TA_ERRORS,
+  TA_COUNTERS
+};
+
+uint table_access_size;
+audit_stats table_access;
+
+ST_FIELD_INFO table_access_stats_fields[]=
+{
+  {"TABLE_SCHEMA", NAME_LEN, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"TABLE_NAME", NAME_LEN, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"READS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"WRITES", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"SELECTS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"INSERTS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"UPDATES", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"DELETES", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"OTHERS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"RESULT_ROWS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"ROWS_CHANGED", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {"ERRORS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_UNSIGNED, 0, 0},
+  {0, 0, MYSQL_TYPE_NULL, 0, 0, 0, 0}
+};
+
+bool table_access_start(void)
+{
+  return audit_stats_init(&table_access, table_access_size, TA_COUNTERS, 0);
+}
+
+void table_access_stop(void)
+{
+  audit_stats_free(&table_access);
+}
+
+static table_access_counter statement_counter(enum_sql_command command)
+{
+  switch (command) {
+  case SQLCOM_SELECT:
+    return TA_SELECTS;
+  case SQLCOM_INSERT:
+  case SQLCOM_INSERT_SELECT:
+  case SQLCOM_REPLACE:
+  case SQLCOM_REPLACE_SELECT:
+  case SQLCOM_LOAD:
+    return TA_INSERTS;
+  case SQLCOM_UPDATE:
+  case SQLCOM_UPDATE_MULTI:
+    return TA_UPDATES;
+  case SQLCOM_DELETE:
+  case SQLCOM_DELETE_MULTI:
+  case SQLCOM_TRUNCATE:
+    return TA_DELETES;
+  default:
+    return TA_OTHERS;
+  }
+}
+
+void table_access_record(MYSQL_THD thd, const struct mysql_event_general *event)
+{
+  longlong changed;
+  char key[AUDIT_STATS_KEY_LEN];
+
+  if (!audit_stats_enabled(&table_access) || !thd->lex || !thd->lex->query_tables)
+    return;
+
+  /* affected rows for DML, -1 for statements that return a result set */
+  changed= thd->get_row_count_func();
+
+  for (TABLE_LIST *table= thd->lex->query_tables; table; table= table->next_local)
+  {
+    longlong delta[TA_COUNTERS]= { 0 };
+    bool write= table->lock_type >= TL_WRITE_ALLOW_WRITE;
+    uint key_length;
+
+    if (!table->db || !table->table_name || !table->db_length ||
+        table->db_length + table->table_name_length + 1 > sizeof(key))
+      continue;
+
+    delta[write ? TA_WRITES : TA_READS]= 1;
+    delta[statement_counter(thd->lex->sql_command)]= 1;
+    if (write)
+      delta[TA_ROWS_CHANGED]= max(changed, 0LL);
+    else
+      delta[TA_RESULT_ROWS]= (longlong) event->general_rows;
+    delta[TA_ERRORS]= event->general_error_code != 0;
+
+    /* schema and table name separated by a zero byte */
+    memcpy(key, table->db, table->db_length);
+    key[table->db_length]= 0;
+    memcpy(key + table->db_length + 1, table->table_name, table->table_name_length);
+    key_length= table->db_length + 1 + table->table_name_length;
+    audit_stats_add(&table_access, key, key_length, delta);
+  }
+}
+
+#if MYSQL_VERSION_ID > 50600
+static int fill_table_access_stats(THD *thd, TABLE_LIST *tables, Item *item)
+#else
+static int fill_table_access_stats(THD *thd, TABLE_LIST *tables, COND *cond)
+#endif
+{
+  TABLE *table= tables->table;
+  CHARSET_INFO *cs= system_charset_info;
+  uchar *rows= NULL;
+  uint count= 0;
+  int error= 0;
+
+  /* the audit plugin cannot free the table while it is read */
+  audit_stats_read_lock();
+  if (audit_stats_enabled(&table_access))
+    count= audit_stats_snapshot(&table_access, &rows);
+  for (uint i= 0; i < count && !error; i++)
+  {
+    audit_stats_row *row= audit_stats_row_at(&table_access, rows, i);
+    uint db_length= strlen(row->key);
+
+    table->field[0]->store(row->key, db_length, cs);
+    table->field[1]->store(row->key + db_length + 1,
+                           row->key_length - db_length - 1, cs);
+    for (uint c= 0; c < TA_COUNTERS; c++)
+      table->field[2 + c]->store(row->counter[c], 1);
+    error= schema_table_store_record(thd, table);
+  }
+  free(rows);
+  audit_stats_read_unlock();
+  return error;
+}
+
+int table_access_stats_init(void *p)
+{
+  ST_SCHEMA_TABLE *schema= (ST_SCHEMA_TABLE*) p;
+  schema->fields_info= table_access_stats_fields;
+  schema->fill_table= fill_table_access_stats;
+  return 0;
+}
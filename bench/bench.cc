@@ -0,0 +1,1002 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: benchmark and replay driver for the plugins.
+
+   The plugins are linked in as they are, against the stand-ins of the
+   server in stubs/, and driven the way mysqld would drive them:
+
+     plugin_bench audit --log general.log   replays a general query log
+                                             through the audit plugin
+     plugin_bench pam                        logs in through pam_auth
+     plugin_bench fill                       fills the I_S tables
+
+   Every plugin call is timed and the allocations it makes are counted;
+   the report gives the throughput and the latency percentiles per kind
+   of call, merged over all threads.
+*/
+#include "bench.h"
+#include <mysql/plugin_audit.h>
+#include <mysql/plugin_auth.h>
+#include <stdio.h>
+#include <time.h>
+#include <ctype.h>
+#include <strings.h>
+#include <getopt.h>
+
+/*
+  Allocation counting: the glibc allocator is wrapped, so that calls
+  made by the plugins, libstdc++ and libc itself are all seen.
+*/
+extern "C" {
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t nmemb, size_t size);
+  void *__libc_realloc(void *ptr, size_t size);
+  void __libc_free(void *ptr);
+}
+
+__thread ulonglong thread_allocs;
+__thread ulonglong thread_alloc_bytes;
+
+extern "C" void *malloc(size_t size)
+{
+  thread_allocs++;
+  thread_alloc_bytes+= size;
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t nmemb, size_t size)
+{
+  thread_allocs++;
+  thread_alloc_bytes+= nmemb * size;
+  return __libc_calloc(nmemb, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+  if (size)
+  {
+    thread_allocs++;
+    thread_alloc_bytes+= size;
+  }
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr)
+{
+  __libc_free(ptr);
+}
+
+/*
+  Histogram
+*/
+static uint hist_bucket(ulonglong ns)
+{
+  if (ns < HIST_LINEAR)
+    return (uint) ns;
+  int msb= 63 - __builtin_clzll(ns);
+  uint sub= (uint) (ns >> (msb - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1);
+  uint bucket= HIST_LINEAR + (msb - 6) * (1 << HIST_SUB_BITS) + sub;
+  return min(bucket, (uint) HIST_BUCKETS - 1);
+}
+
+/* the upper bound of a bucket */
+static ulonglong hist_value(uint bucket)
+{
+  if (bucket < HIST_LINEAR)
+    return bucket;
+  uint msb= (bucket - HIST_LINEAR) / (1 << HIST_SUB_BITS) + 6;
+  uint sub= (bucket - HIST_LINEAR) % (1 << HIST_SUB_BITS);
+  ulonglong width= 1ULL << (msb - HIST_SUB_BITS);
+  return (((1ULL << HIST_SUB_BITS) + sub) << (msb - HIST_SUB_BITS)) + width - 1;
+}
+
+void latency_histogram::add(ulonglong ns)
+{
+  counts[hist_bucket(ns)]++;
+  calls++;
+  total_ns+= ns;
+  if (ns > max_ns)
+    max_ns= ns;
+}
+
+void latency_histogram::merge(const latency_histogram &other)
+{
+  for (uint i= 0; i < HIST_BUCKETS; i++)
+    counts[i]+= other.counts[i];
+  calls+= other.calls;
+  total_ns+= other.total_ns;
+  max_ns= max(max_ns, other.max_ns);
+  allocs+= other.allocs;
+  alloc_bytes+= other.alloc_bytes;
+}
+
+ulonglong latency_histogram::percentile(double percent) const
+{
+  ulonglong target= (ulonglong) (calls * percent / 100.0 + 0.5);
+  ulonglong seen= 0;
+
+  if (!target)
+    target= 1;
+  for (uint i= 0; i < HIST_BUCKETS; i++)
+  {
+    seen+= counts[i];
+    if (seen >= target)
+      return min(hist_value(i), max_ns);
+  }
+  return max_ns;
+}
+
+ulonglong now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ulonglong) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+  Plugins linked into the bench
+*/
+extern "C" {
+  extern struct st_mysql_plugin bench_audit_syslog_plugin[];
+  extern struct st_mysql_plugin bench_pam_auth_plugin[];
+  extern struct st_mysql_plugin bench_mysql_is_sys_usage_plugin[];
+  extern struct st_mysql_plugin bench_mysql_is_query_cache_result_plugin[];
+  extern struct st_mysql_plugin bench_mysql_is_query_cache_table_plugin[];
+  extern struct st_mysql_plugin bench_mysql_is_cpu_profiler_plugin[];
+}
+
+static struct st_mysql_plugin *libraries[]=
+{
+  bench_audit_syslog_plugin,
+  bench_pam_auth_plugin,
+  bench_mysql_is_sys_usage_plugin,
+  bench_mysql_is_query_cache_result_plugin,
+  bench_mysql_is_query_cache_table_plugin,
+  bench_mysql_is_cpu_profiler_plugin,
+  NULL
+};
+
+struct is_table
+{
+  const char *name;
+  ST_SCHEMA_TABLE schema;
+  uint fields;
+};
+
+static std::vector<st_mysql_plugin*> installed;
+static std::vector<is_table*> is_tables;
+static st_mysql_audit *audit;
+static st_mysql_auth *auth;
+
+/* --set name=value */
+static std::vector<std::pair<std::string, std::string> > overrides;
+
+static std::string sysvar_name(const st_mysql_plugin *plugin, const st_mysql_sys_var *var)
+{
+  std::string name(plugin->name);
+  for (size_t i= 0; i < name.size(); i++)
+    name[i]= tolower(name[i]);
+  return name + "_" + var->name;
+}
+
+static bool sysvar_set(st_mysql_sys_var *var, const char *value)
+{
+  char *end;
+  longlong number= strtoll(value, &end, 0);
+  bool numeric= *value && !*end;
+
+  switch (var->flags & 0x7f) {
+  case PLUGIN_VAR_BOOL:
+    *(my_bool*) var->value= !strcasecmp(value, "on") || !strcasecmp(value, "true") ||
+                            (numeric && number);
+    return true;
+  case PLUGIN_VAR_STR:
+    *(char**) var->value= strdup(value);
+    return true;
+  case PLUGIN_VAR_ENUM:
+    if (!numeric && var->typelib)
+    {
+      for (number= 0; number < (longlong) var->typelib->count; number++)
+        if (!strcasecmp(var->typelib->type_names[number], value))
+          break;
+      numeric= number < (longlong) var->typelib->count;
+    }
+    if (!numeric)
+      return false;
+    *(ulong*) var->value= (ulong) number;
+    return true;
+  case PLUGIN_VAR_INT:
+    if (!numeric)
+      return false;
+    *(int*) var->value= (int) number;
+    return true;
+  case PLUGIN_VAR_LONG:
+    if (!numeric)
+      return false;
+    *(long*) var->value= (long) number;
+    return true;
+  case PLUGIN_VAR_LONGLONG:
+  case PLUGIN_VAR_SET:
+    if (!numeric)
+      return false;
+    *(longlong*) var->value= number;
+    return true;
+  }
+  return false;
+}
+
+/* an INT variable of an installed plugin, 0 if there is none */
+static int sysvar_int(const char *name)
+{
+  for (size_t i= 0; i < installed.size(); i++)
+    for (st_mysql_sys_var **var= installed[i]->system_vars; var && *var; var++)
+      if ((*var)->flags & PLUGIN_VAR_INT && sysvar_name(installed[i], *var) == name)
+        return *(int*) (*var)->value;
+  return 0;
+}
+
+static void sysvar_default(st_mysql_sys_var *var)
+{
+  switch (var->flags & 0x7f) {
+  case PLUGIN_VAR_BOOL:
+    *(my_bool*) var->value= (my_bool) var->def_val;
+    break;
+  case PLUGIN_VAR_STR:
+    *(const char**) var->value= var->def_str;
+    break;
+  case PLUGIN_VAR_ENUM:
+    *(ulong*) var->value= (ulong) var->def_val;
+    break;
+  case PLUGIN_VAR_INT:
+    *(int*) var->value= (int) var->def_val;
+    break;
+  case PLUGIN_VAR_LONG:
+    *(long*) var->value= (long) var->def_val;
+    break;
+  default:
+    *(longlong*) var->value= var->def_val;
+    break;
+  }
+}
+
+/* sets the variables and runs the init functions, like INSTALL PLUGIN */
+static bool install_plugins()
+{
+  std::vector<bool> used(overrides.size());
+
+  for (st_mysql_plugin **library= libraries; *library; library++)
+    for (st_mysql_plugin *plugin= *library; plugin->name; plugin++)
+    {
+      for (st_mysql_sys_var **var= plugin->system_vars; var && *var; var++)
+      {
+        std::string name= sysvar_name(plugin, *var);
+        sysvar_default(*var);
+        for (size_t i= 0; i < overrides.size(); i++)
+          if (overrides[i].first == name)
+          {
+            if (!sysvar_set(*var, overrides[i].second.c_str()))
+            {
+              fprintf(stderr, "bad value for %s: %s\n", name.c_str(),
+                      overrides[i].second.c_str());
+              return false;
+            }
+            used[i]= true;
+          }
+      }
+
+      void *arg= NULL;
+      if (plugin->type == MYSQL_INFORMATION_SCHEMA_PLUGIN)
+      {
+        is_table *table= new is_table();
+        table->name= plugin->name;
+        table->schema.table_name= plugin->name;
+        arg= &table->schema;
+        is_tables.push_back(table);
+      }
+      if (plugin->init && plugin->init(arg))
+      {
+        fprintf(stderr, "plugin %s failed to initialize\n", plugin->name);
+        return false;
+      }
+      installed.push_back(plugin);
+
+      if (plugin->type == MYSQL_INFORMATION_SCHEMA_PLUGIN)
+      {
+        is_table *table= is_tables.back();
+        for (ST_FIELD_INFO *field= table->schema.fields_info;
+             field && field->field_name; field++)
+          table->fields++;
+      }
+      else if (plugin->type == MYSQL_AUDIT_PLUGIN)
+        audit= (st_mysql_audit*) plugin->info;
+      else if (plugin->type == MYSQL_AUTHENTICATION_PLUGIN)
+        auth= (st_mysql_auth*) plugin->info;
+    }
+
+  for (size_t i= 0; i < overrides.size(); i++)
+    if (!used[i])
+    {
+      fprintf(stderr, "unknown variable %s\n", overrides[i].first.c_str());
+      return false;
+    }
+  return true;
+}
+
+static void uninstall_plugins()
+{
+  for (size_t i= installed.size(); i-- > 0; )
+  {
+    st_mysql_plugin *plugin= installed[i];
+    void *arg= NULL;
+    for (size_t j= 0; j < is_tables.size(); j++)
+      if (is_tables[j]->name == plugin->name)
+        arg= &is_tables[j]->schema;
+    if (plugin->deinit)
+      plugin->deinit(arg);
+  }
+}
+
+/*
+  Options
+*/
+static uint opt_threads= 1;
+static uint opt_loops= 1;
+static uint opt_iterations= 100000;
+static bool opt_pam;
+static uint opt_bad_password_percent;
+static uint opt_users= 100;
+static uint opt_qc_queries= 1000;
+static uint opt_qc_result_blocks= 4;
+static uint opt_qc_tables= 100;
+static const char *opt_log;
+
+/*
+  Kinds of timed calls, each thread keeps a histogram per kind
+*/
+static std::vector<std::string> op_names;
+
+static uint register_op(const std::string &name)
+{
+  op_names.push_back(name);
+  return op_names.size() - 1;
+}
+
+struct worker
+{
+  pthread_t thread;
+  uint id;
+  std::vector<latency_histogram> hist;
+  std::vector<size_t> connections;              /* audit: replayed by this thread */
+};
+
+static pthread_barrier_t start_barrier;
+static bool check_failed;                       /* a self-check of the mode failed */
+
+#define TIMED(W, OP, CALL)                                              \
+  do {                                                                  \
+    ulonglong allocs_= thread_allocs, bytes_= thread_alloc_bytes;       \
+    ulonglong start_= now_ns();                                         \
+    CALL;                                                               \
+    latency_histogram &h_= (W)->hist[OP];                               \
+    h_.add(now_ns() - start_);                                          \
+    h_.allocs+= thread_allocs - allocs_;                                \
+    h_.alloc_bytes+= thread_alloc_bytes - bytes_;                       \
+  } while (0)
+
+/*
+  Client side of the dialog plugin: answers every prompt with the password
+*/
+struct bench_vio
+{
+  MYSQL_PLUGIN_VIO vio;
+  const char *password;
+};
+
+static int vio_read_packet(MYSQL_PLUGIN_VIO *vio, unsigned char **buf)
+{
+  bench_vio *client= (bench_vio*) vio;
+  *buf= (unsigned char*) client->password;
+  return strlen(client->password);
+}
+
+static int vio_write_packet(MYSQL_PLUGIN_VIO *vio, const unsigned char *packet,
+                            int packet_len)
+{
+  return 0;
+}
+
+static void vio_info(MYSQL_PLUGIN_VIO *vio, MYSQL_PLUGIN_VIO_INFO *info)
+{
+  info->protocol= MYSQL_PLUGIN_VIO_INFO::MYSQL_VIO_TCP;
+  info->socket= -1;
+}
+
+static int authenticate(const char *user, const char *host, const char *password)
+{
+  bench_vio client;
+  MYSQL_SERVER_AUTH_INFO info;
+
+  client.vio.read_packet= vio_read_packet;
+  client.vio.write_packet= vio_write_packet;
+  client.vio.info= vio_info;
+  client.password= password;
+
+  memset(&info, 0, sizeof(info));
+  info.user_name= (char*) user;
+  info.user_name_length= strlen(user);
+  info.auth_string= "mysql";
+  info.auth_string_length= 5;
+  info.host_or_ip= host;
+  info.host_or_ip_length= strlen(host);
+  return auth->authenticate_user(&client.vio, &info);
+}
+
+static const char *wrong_password(uint *seed)
+{
+  return opt_bad_password_percent &&
+         (uint) rand_r(seed) % 100 < opt_bad_password_percent ? "wrong" : fake_pam_password;
+}
+
+/*
+  audit: replay of a general log
+*/
+static std::vector<log_event> events;
+static std::vector<std::vector<size_t> > connection_events;
+static uint op_general[4], op_connection[3], op_pam_login;
+
+struct connection_state
+{
+  THD thd;
+  char user[256], host[256], db[256];
+  char general_user[1024];
+  uint general_user_length;
+};
+
+static void connection_login(connection_state *conn, const char *user,
+                             const char *host, const char *db)
+{
+  snprintf(conn->user, sizeof(conn->user), "%s", user);
+  snprintf(conn->host, sizeof(conn->host), "%s", host);
+  snprintf(conn->db, sizeof(conn->db), "%s", db);
+
+  Security_context *sctx= &conn->thd.main_security_ctx;
+  sctx->user= sctx->priv_user= conn->user;
+  sctx->host= sctx->ip= conn->host;
+  sctx->host_or_ip= conn->host;
+  conn->thd.db= *conn->db ? conn->db : NULL;
+  conn->thd.db_length= strlen(conn->db);
+  conn->general_user_length=
+    snprintf(conn->general_user, sizeof(conn->general_user), "%s[%s] @ %s [%s]",
+             user, user, host, host);
+}
+
+static void notify_connection(worker *w, connection_state *conn, uint subclass,
+                              int status)
+{
+  mysql_event_connection event;
+  memset(&event, 0, sizeof(event));
+  event.event_subclass= subclass;
+  event.status= status;
+  event.thread_id= conn->thd.thread_id;
+  event.user= event.priv_user= conn->user;
+  event.user_length= event.priv_user_length= strlen(conn->user);
+  event.host= event.ip= conn->host;
+  event.host_length= event.ip_length= strlen(conn->host);
+  event.database= conn->db;
+  event.database_length= strlen(conn->db);
+  TIMED(w, op_connection[subclass],
+        audit->event_notify(&conn->thd, MYSQL_AUDIT_CONNECTION_CLASS, &event));
+}
+
+static void notify_general(worker *w, connection_state *conn, const log_event &log,
+                           uint subclass)
+{
+  mysql_event_general event;
+  memset(&event, 0, sizeof(event));
+  event.event_subclass= subclass;
+  event.general_thread_id= conn->thd.thread_id;
+  event.general_user= conn->general_user;
+  event.general_user_length= conn->general_user_length;
+  event.general_command= log.name;
+  event.general_command_length= strlen(log.name);
+  event.general_query= log.argument;
+  event.general_query_length= log.argument_length;
+  event.general_charset= system_charset_info;
+  event.general_time= time(NULL);
+  TIMED(w, op_general[subclass],
+        audit->event_notify(&conn->thd, MYSQL_AUDIT_GENERAL_CLASS, &event));
+}
+
+static void replay_connection(worker *w, const std::vector<size_t> &indexes,
+                              uint *seed)
+{
+  connection_state *conn= new connection_state();
+  bool connected= false;
+
+  for (size_t i= 0; i < indexes.size(); i++)
+  {
+    const log_event &log= events[indexes[i]];
+    char user[256], host[256], db[256];
+
+    if (!connected)
+    {
+      /* connected before the log started */
+      conn->thd.thread_id= log.thread_id;
+      connection_login(conn, "bench", "localhost", "");
+      conn->thd.thr_create_utime= my_micro_time();
+      connected= true;
+    }
+
+    switch (log.command) {
+    case CMD_CONNECT:
+    {
+      int status= 0;
+      if (!parse_connect(log, user, host, db, sizeof(db)))
+        break;
+      connection_login(conn, user, host, db);
+      conn->thd.thr_create_utime= my_micro_time();
+      if (opt_pam && auth)
+      {
+        int result;
+        TIMED(w, op_pam_login, result= authenticate(user, host, wrong_password(seed)));
+        if (result != CR_OK)
+          status= 1045;                         /* ER_ACCESS_DENIED_ERROR */
+      }
+      notify_connection(w, conn, MYSQL_AUDIT_CONNECTION_CONNECT, status);
+      break;
+    }
+    case CMD_QUIT:
+      notify_connection(w, conn, MYSQL_AUDIT_CONNECTION_DISCONNECT, 0);
+      break;
+    case CMD_CHANGE_USER:
+      connection_login(conn, log.argument, conn->host, conn->db);
+      notify_connection(w, conn, MYSQL_AUDIT_CONNECTION_CHANGE_USER, 0);
+      break;
+    case CMD_INIT_DB:
+      snprintf(conn->db, sizeof(conn->db), "%s", log.argument);
+      conn->thd.db= conn->db;
+      conn->thd.db_length= strlen(conn->db);
+      break;
+    case CMD_QUERY:
+      conn->thd.lex= (LEX*) &log.lex;
+      conn->thd.query_id++;
+      notify_general(w, conn, log, MYSQL_AUDIT_GENERAL_LOG);
+      if (log.lex.sql_command == SQLCOM_SELECT ||
+          log.lex.sql_command == SQLCOM_SHOW_VARIABLES)
+        notify_general(w, conn, log, MYSQL_AUDIT_GENERAL_RESULT);
+      notify_general(w, conn, log, MYSQL_AUDIT_GENERAL_STATUS);
+      conn->thd.lex= NULL;
+      break;
+    default:
+      break;
+    }
+  }
+  delete conn;
+}
+
+static void *audit_worker(void *arg)
+{
+  worker *w= (worker*) arg;
+  uint seed= w->id;
+
+  pthread_barrier_wait(&start_barrier);
+  for (uint loop= 0; loop < opt_loops; loop++)
+    for (size_t i= 0; i < w->connections.size(); i++)
+      replay_connection(w, connection_events[w->connections[i]], &seed);
+  return NULL;
+}
+
+static bool audit_setup(std::vector<worker*> &workers)
+{
+  if (!audit)
+  {
+    fprintf(stderr, "no audit plugin\n");
+    return false;
+  }
+  if (!opt_log || !read_general_log(opt_log, events))
+  {
+    fprintf(stderr, "cannot read the general log, give it with --log\n");
+    return false;
+  }
+
+  /* events of a connection stay in order and on one thread */
+  std::vector<ulong> ids;
+  for (size_t i= 0; i < events.size(); i++)
+  {
+    size_t c;
+    for (c= ids.size(); c-- > 0 && ids[c] != events[i].thread_id; )
+      ;
+    if (c == (size_t) -1)
+    {
+      c= ids.size();
+      ids.push_back(events[i].thread_id);
+      connection_events.push_back(std::vector<size_t>());
+    }
+    connection_events[c].push_back(i);
+  }
+  for (size_t c= 0; c < connection_events.size(); c++)
+    workers[c % workers.size()]->connections.push_back(c);
+
+  op_general[MYSQL_AUDIT_GENERAL_LOG]= register_op("general_log");
+  op_general[MYSQL_AUDIT_GENERAL_ERROR]= register_op("general_error");
+  op_general[MYSQL_AUDIT_GENERAL_RESULT]= register_op("general_result");
+  op_general[MYSQL_AUDIT_GENERAL_STATUS]= register_op("general_status");
+  op_connection[MYSQL_AUDIT_CONNECTION_CONNECT]= register_op("connect");
+  op_connection[MYSQL_AUDIT_CONNECTION_DISCONNECT]= register_op("disconnect");
+  op_connection[MYSQL_AUDIT_CONNECTION_CHANGE_USER]= register_op("change_user");
+  op_pam_login= register_op("pam_auth");
+
+  printf("replaying %zu events of %zu connections from %s\n",
+         events.size(), connection_events.size(), opt_log);
+  return true;
+}
+
+/*
+  After the replay every STATUS event must be counted in
+  USER_RESOURCE_USAGE.STATEMENTS, whatever the sample rate.
+*/
+static longlong counted_statements;
+
+static void count_statements(TABLE *table)
+{
+  counted_statements+= bench_field_integer(table->field[2]);
+}
+
+static void check_resource_usage(const std::vector<worker*> &workers)
+{
+  ulonglong replayed= 0;
+  THD thd= THD();
+  TABLE_LIST tables;
+
+  if (!sysvar_int("audit_syslog_resource_usage_size"))
+    return;
+  for (size_t t= 0; t < is_tables.size(); t++)
+  {
+    if (strcmp(is_tables[t]->name, "USER_RESOURCE_USAGE"))
+      continue;
+    tables.table= bench_table_new(is_tables[t]->fields);
+    bench_record_hook= count_statements;
+    is_tables[t]->schema.fill_table(&thd, &tables, NULL);
+    bench_record_hook= NULL;
+  }
+  for (size_t i= 0; i < workers.size(); i++)
+    replayed+= workers[i]->hist[op_general[MYSQL_AUDIT_GENERAL_STATUS]].calls;
+
+  printf("resource usage: %lld statements counted, %llu replayed\n",
+         counted_statements, replayed);
+  if ((ulonglong) counted_statements != replayed)
+    check_failed= true;
+}
+
+/*
+  pam: logins through pam_auth and the fake libpam
+*/
+static void *pam_worker(void *arg)
+{
+  worker *w= (worker*) arg;
+  uint seed= w->id;
+  char user[64], host[64];
+
+  pthread_barrier_wait(&start_barrier);
+  for (uint i= 0; i < opt_iterations; i++)
+  {
+    uint n= (uint) rand_r(&seed) % opt_users;
+    snprintf(user, sizeof(user), "user%u", n);
+    snprintf(host, sizeof(host), "10.0.%u.%u", n / 250 % 250, n % 250 + 1);
+    TIMED(w, op_pam_login, authenticate(user, host, wrong_password(&seed)));
+  }
+  return NULL;
+}
+
+static bool pam_setup()
+{
+  if (!auth)
+  {
+    fprintf(stderr, "no authentication plugin\n");
+    return false;
+  }
+  op_pam_login= register_op("pam_auth");
+  return true;
+}
+
+/*
+  throttle: a host over pam_auth_throttle_host_threshold must be let back
+  in once its failures leave the window, although it keeps retrying and
+  other clients keep logging in meanwhile.  Thread 1 is that host.
+*/
+static uint op_throttled_login;
+static volatile bool throttle_done;
+
+static void throttled_client(worker *w)
+{
+  const char *user= "locked", *host= "10.255.255.1";
+  uint threshold= sysvar_int("pam_auth_throttle_host_threshold");
+  uint window= sysvar_int("pam_auth_throttle_window");
+  ulonglong locked, deadline;
+  int rc= CR_ERROR;
+
+  for (uint i= 0; i < threshold; i++)
+    TIMED(w, op_pam_login, authenticate(user, host, "wrong"));
+  locked= now_ns();
+  deadline= locked + (2 * window + 1) * 1000000000ULL;
+
+  TIMED(w, op_throttled_login, rc= authenticate(user, host, fake_pam_password));
+  if (rc == CR_OK)
+  {
+    printf("throttle: host not locked after %u failures\n", threshold);
+    check_failed= true;
+    return;
+  }
+  while (rc != CR_OK && now_ns() < deadline)
+  {
+    usleep(10000);
+    TIMED(w, op_throttled_login, rc= authenticate(user, host, fake_pam_password));
+  }
+  if (rc == CR_OK)
+    printf("throttle: host let back in after %.2f s, window %u s\n",
+           (now_ns() - locked) / 1e9, window);
+  else
+  {
+    printf("throttle: host still locked after %u s, window %u s\n",
+           2 * window + 1, window);
+    check_failed= true;
+  }
+}
+
+static void *throttle_worker(void *arg)
+{
+  worker *w= (worker*) arg;
+  uint seed= w->id;
+  char user[64], host[64];
+
+  pthread_barrier_wait(&start_barrier);
+  if (w->id == 1)
+  {
+    throttled_client(w);
+    throttle_done= true;
+    return NULL;
+  }
+  while (!throttle_done)
+  {
+    uint n= (uint) rand_r(&seed) % opt_users;
+    snprintf(user, sizeof(user), "user%u", n);
+    snprintf(host, sizeof(host), "10.0.%u.%u", n / 250 % 250, n % 250 + 1);
+    TIMED(w, op_pam_login, authenticate(user, host, wrong_password(&seed)));
+  }
+  return NULL;
+}
+
+static bool throttle_setup()
+{
+  if (!pam_setup())
+    return false;
+  if (!sysvar_int("pam_auth_throttle_host_threshold"))
+  {
+    fprintf(stderr, "throttle needs --set pam_auth_throttle_host_threshold=N\n");
+    return false;
+  }
+  op_throttled_login= register_op("pam_auth throttled host");
+  return true;
+}
+
+/*
+  fill: I_S tables
+*/
+static uint op_fill_first;
+
+static void *fill_worker(void *arg)
+{
+  worker *w= (worker*) arg;
+  THD thd= THD();
+  std::vector<TABLE_LIST> tables(is_tables.size());
+
+  for (size_t t= 0; t < is_tables.size(); t++)
+    tables[t].table= bench_table_new(is_tables[t]->fields);
+
+  pthread_barrier_wait(&start_barrier);
+  for (uint i= 0; i < opt_iterations; i++)
+    for (size_t t= 0; t < is_tables.size(); t++)
+      TIMED(w, op_fill_first + t,
+            is_tables[t]->schema.fill_table(&thd, &tables[t], NULL));
+  return NULL;
+}
+
+static bool fill_setup()
+{
+  bench_query_cache_fill(opt_qc_queries, opt_qc_result_blocks, opt_qc_tables);
+  for (size_t t= 0; t < is_tables.size(); t++)
+  {
+    uint op= register_op(std::string("fill:") + is_tables[t]->name);
+    if (!t)
+      op_fill_first= op;
+  }
+  return true;
+}
+
+/*
+  Report
+*/
+static void report(const std::vector<worker*> &workers, double seconds)
+{
+  printf("%u threads, %.3f s\n\n", (uint) workers.size(), seconds);
+  printf("%-32s %10s %11s %9s %9s %9s %9s %9s %8s %8s\n", "call", "calls", "calls/s",
+         "p50 ns", "p90 ns", "p99 ns", "p99.9 ns", "max ns", "allocs", "bytes");
+
+  for (size_t op= 0; op < op_names.size(); op++)
+  {
+    latency_histogram *total= new latency_histogram();
+    for (size_t i= 0; i < workers.size(); i++)
+      total->merge(workers[i]->hist[op]);
+    if (total->calls)
+      printf("%-32s %10llu %11.0f %9llu %9llu %9llu %9llu %9llu %8.1f %8.0f\n",
+             op_names[op].c_str(), total->calls, total->calls / seconds,
+             total->percentile(50), total->percentile(90), total->percentile(99),
+             total->percentile(99.9), total->max_ns,
+             (double) total->allocs / total->calls,
+             (double) total->alloc_bytes / total->calls);
+    delete total;
+  }
+  printf("\nsyslog lines: %lld\n", syslog_lines);
+
+  /* non-zero counters of SHOW STATUS */
+  for (size_t i= 0; i < installed.size(); i++)
+    for (st_mysql_show_var *var= installed[i]->status_vars; var && var->name; var++)
+    {
+      longlong value= 0;
+      if (var->type == SHOW_INT)
+        value= *(int*) var->value;
+      else if (var->type == SHOW_LONG)
+        value= *(long*) var->value;
+      else if (var->type == SHOW_LONGLONG)
+        value= *(longlong*) var->value;
+      if (value)
+        printf("%s: %lld\n", var->name, value);
+    }
+}
+
+static void usage()
+{
+  fprintf(stderr,
+"usage: plugin_bench audit|pam|throttle|fill [options]\n"
+"  --threads N               threads to run (1)\n"
+"  --set VAR=VALUE           plugin variable, e.g. audit_syslog_host=localhost\n"
+"audit:\n"
+"  --log FILE                general query log to replay\n"
+"  --loops N                 times to replay it (1)\n"
+"  --pam                     log in through pam_auth on Connect\n"
+"pam, fill:\n"
+"  --iterations N            calls per thread (100000)\n"
+"pam, throttle:\n"
+"  --users N                 distinct users and hosts (100)\n"
+"  --pam-latency-us N        time the fake PAM module takes (0)\n"
+"  --bad-password-percent N  share of logins with a wrong password (0)\n"
+"throttle:\n"
+"  needs --set pam_auth_throttle_host_threshold=N, thread 1 is the host\n"
+"  over it and the run fails if it is not let back in within two windows\n"
+"fill:\n"
+"  --qc-queries N            queries in the fake query cache (1000)\n"
+"  --qc-result-blocks N      result blocks per query (4)\n"
+"  --qc-tables N             tables in the fake query cache (100)\n");
+}
+
+int main(int argc, char **argv)
+{
+  static struct option options[]=
+  {
+    { "threads",              required_argument, NULL, 't' },
+    { "set",                  required_argument, NULL, 's' },
+    { "log",                  required_argument, NULL, 'l' },
+    { "loops",                required_argument, NULL, 'L' },
+    { "pam",                  no_argument,       NULL, 'p' },
+    { "iterations",           required_argument, NULL, 'i' },
+    { "users",                required_argument, NULL, 'u' },
+    { "pam-latency-us",       required_argument, NULL, 'P' },
+    { "bad-password-percent", required_argument, NULL, 'b' },
+    { "qc-queries",           required_argument, NULL, 'q' },
+    { "qc-result-blocks",     required_argument, NULL, 'r' },
+    { "qc-tables",            required_argument, NULL, 'T' },
+    { "help",                 no_argument,       NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  int c;
+
+  while ((c= getopt_long(argc, argv, "t:s:l:L:pi:u:P:b:q:r:T:h", options, NULL)) != -1)
+  {
+    switch (c) {
+    case 't': opt_threads= max(atoi(optarg), 1); break;
+    case 'l': opt_log= optarg; break;
+    case 'L': opt_loops= atoi(optarg); break;
+    case 'p': opt_pam= true; break;
+    case 'i': opt_iterations= atoi(optarg); break;
+    case 'u': opt_users= max(atoi(optarg), 1); break;
+    case 'P': fake_pam_latency_us= atoi(optarg); break;
+    case 'b': opt_bad_password_percent= atoi(optarg); break;
+    case 'q': opt_qc_queries= atoi(optarg); break;
+    case 'r': opt_qc_result_blocks= atoi(optarg); break;
+    case 'T': opt_qc_tables= atoi(optarg); break;
+    case 's':
+    {
+      const char *eq= strchr(optarg, '=');
+      if (!eq)
+      {
+        usage();
+        return 1;
+      }
+      overrides.push_back(std::make_pair(std::string(optarg, eq - optarg),
+                                         std::string(eq + 1)));
+      break;
+    }
+    default:
+      usage();
+      return 1;
+    }
+  }
+  if (optind != argc - 1)
+  {
+    usage();
+    return 1;
+  }
+
+  const char *mode= argv[optind];
+  void *(*run)(void*);
+  std::vector<worker*> workers;
+  for (uint i= 0; i < opt_threads; i++)
+  {
+    workers.push_back(new worker());
+    workers[i]->id= i + 1;
+  }
+
+  if (!install_plugins())
+    return 1;
+
+  bool ok;
+  if (!strcmp(mode, "audit"))
+  {
+    ok= audit_setup(workers);
+    run= audit_worker;
+  }
+  else if (!strcmp(mode, "pam"))
+  {
+    ok= pam_setup();
+    run= pam_worker;
+  }
+  else if (!strcmp(mode, "throttle"))
+  {
+    ok= throttle_setup();
+    run= throttle_worker;
+  }
+  else if (!strcmp(mode, "fill"))
+  {
+    ok= fill_setup();
+    run= fill_worker;
+  }
+  else
+  {
+    usage();
+    ok= false;
+  }
+  if (!ok)
+  {
+    uninstall_plugins();
+    return 1;
+  }
+
+  pthread_barrier_init(&start_barrier, NULL, opt_threads + 1);
+  for (uint i= 0; i < opt_threads; i++)
+  {
+    workers[i]->hist.resize(op_names.size());
+    pthread_create(&workers[i]->thread, NULL, run, workers[i]);
+  }
+  pthread_barrier_wait(&start_barrier);
+  ulonglong start= now_ns();
+  for (uint i= 0; i < opt_threads; i++)
+    pthread_join(workers[i]->thread, NULL);
+  double seconds= (now_ns() - start) / 1e9;
+
+  report(workers, seconds);
+  if (run == audit_worker)
+    check_resource_usage(workers);
+  uninstall_plugins();
+  return check_failed ? 1 : 0;
+}
@@ -0,0 +1,72 @@
+#ifndef PLUGIN_BENCH_H
+#define PLUGIN_BENCH_H
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: shared declarations of the plugin benchmark.
+*/
+/* before my_global.h, which defines min() and max() */
+#include <vector>
+#include <string>
+#include "sql_class.h"
+
+/*
+  Latency histogram in nanoseconds: exact below HIST_LINEAR, then
+  2^HIST_SUB_BITS sub-buckets per power of two, about 3% resolution.
+*/
+#define HIST_LINEAR 64
+#define HIST_SUB_BITS 5
+#define HIST_BUCKETS (HIST_LINEAR + 40 * (1 << HIST_SUB_BITS))
+
+struct latency_histogram
+{
+  ulonglong counts[HIST_BUCKETS];
+  ulonglong calls, total_ns, max_ns;
+  ulonglong allocs, alloc_bytes;
+
+  void add(ulonglong ns);
+  void merge(const latency_histogram &other);
+  ulonglong percentile(double percent) const;
+};
+
+ulonglong now_ns();
+
+/* counted by the malloc wrappers in bench.cc */
+extern __thread ulonglong thread_allocs;
+extern __thread ulonglong thread_alloc_bytes;
+
+/* server_stubs.cc */
+extern volatile long long syslog_lines;
+extern __thread ulonglong stored_rows;
+extern void (*bench_record_hook)(TABLE *table); /* sees every stored I_S row */
+longlong bench_field_integer(Field *field);
+TABLE *bench_table_new(uint fields);
+void bench_query_cache_fill(uint queries, uint result_blocks, uint tables);
+
+/* fake_pam.c */
+extern "C" {
+  extern unsigned int fake_pam_latency_us;
+  extern const char *fake_pam_password;
+}
+
+/* general_log.cc */
+enum log_command
+{
+  CMD_CONNECT, CMD_QUIT, CMD_QUERY, CMD_INIT_DB, CMD_CHANGE_USER, CMD_OTHER
+};
+
+struct log_event
+{
+  ulong thread_id;
+  log_command command;
+  char *name;                                   /* command as logged */
+  char *argument;
+  size_t argument_length;
+  LEX lex;                                      /* statement type and tables */
+};
+
+bool read_general_log(const char *path, std::vector<log_event> &events);
+bool parse_connect(const log_event &event, char *user, char *host,
+                   char *db, size_t size);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: in-process stand-in for libpam, in the spirit of pam_wrapper.
+
+   Every service behaves like a stack with a single password module: it
+   asks "Password: " through the conversation function, waits
+   fake_pam_latency_us to imitate a directory server, and accepts the
+   reply if it equals fake_pam_password.  A user named "unknown..." does
+   not exist.  Enough to drive the whole pam_auth code path without a
+   PAM installation or root privileges.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <security/pam_appl.h>
+
+unsigned int fake_pam_latency_us = 0;
+const char *fake_pam_password = "secret";
+
+struct pam_handle {
+  char *service;
+  char *user;
+  struct pam_conv conv;
+};
+
+int pam_start(const char *service_name, const char *user,
+              const struct pam_conv *pam_conversation, pam_handle_t **pamh)
+{
+  pam_handle_t *h = calloc(1, sizeof(pam_handle_t));
+  if (!h)
+    return PAM_BUF_ERR;
+  h->service = strdup(service_name);
+  h->user = user ? strdup(user) : NULL;
+  h->conv = *pam_conversation;
+  *pamh = h;
+  return PAM_SUCCESS;
+}
+
+int pam_end(pam_handle_t *pamh, int pam_status)
+{
+  if (!pamh)
+    return PAM_SYSTEM_ERR;
+  free(pamh->service);
+  free(pamh->user);
+  free(pamh);
+  return PAM_SUCCESS;
+}
+
+int pam_authenticate(pam_handle_t *pamh, int flags)
+{
+  struct pam_message msg = { PAM_PROMPT_ECHO_OFF, "Password: " };
+  const struct pam_message *msgs = &msg;
+  struct pam_response *resp = NULL;
+  int status;
+
+  status = pamh->conv.conv(1, &msgs, &resp, pamh->conv.appdata_ptr);
+  if (status != PAM_SUCCESS)
+    return PAM_CONV_ERR;
+  if (!resp || !resp[0].resp) {
+    free(resp);
+    return PAM_CONV_ERR;
+  }
+
+  if (fake_pam_latency_us)
+    usleep(fake_pam_latency_us);
+
+  if (pamh->user && !strncmp(pamh->user, "unknown", 7))
+    status = PAM_USER_UNKNOWN;
+  else
+    status = strcmp(resp[0].resp, fake_pam_password) ? PAM_AUTH_ERR : PAM_SUCCESS;
+
+  free(resp[0].resp);
+  free(resp);
+  return status;
+}
+
+int pam_acct_mgmt(pam_handle_t *pamh, int flags)
+{
+  return PAM_SUCCESS;
+}
+
+int pam_get_item(const pam_handle_t *pamh, int item_type, const void **item)
+{
+  switch (item_type) {
+  case PAM_SERVICE:
+    *item = pamh->service;
+    return PAM_SUCCESS;
+  case PAM_USER:
+    *item = pamh->user;
+    return PAM_SUCCESS;
+  default:
+    return PAM_BAD_ITEM;
+  }
+}
+
+const char *pam_strerror(pam_handle_t *pamh, int errnum)
+{
+  switch (errnum) {
+  case PAM_SUCCESS:
+    return "Success";
+  case PAM_AUTH_ERR:
+    return "Authentication failure";
+  case PAM_USER_UNKNOWN:
+    return "User not known to the underlying authentication module";
+  case PAM_CONV_ERR:
+    return "Conversation error";
+  default:
+    return "Unknown PAM error";
+  }
+}
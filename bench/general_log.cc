@@ -0,0 +1,296 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: reader of the MySQL general query log for replay.
+
+   A record starts with an optional timestamp, the connection id, the
+   command and a tab; lines that do not look like that continue the
+   argument of the previous record (multi-line queries).  Statements get
+   a rough LEX: the command from the first keyword and the tables named
+   after FROM, JOIN, INTO, UPDATE and TABLE, which is what the audit
+   plugin looks at.
+*/
+#include "bench.h"
+#include <stdio.h>
+#include <ctype.h>
+#include <strings.h>
+
+static char *skip_space(char *p)
+{
+  while (*p == ' ' || *p == '\t')
+    p++;
+  return p;
+}
+
+static log_command command_of(const char *name)
+{
+  if (!strcmp(name, "Connect"))
+    return CMD_CONNECT;
+  if (!strcmp(name, "Quit"))
+    return CMD_QUIT;
+  if (!strcmp(name, "Query") || !strcmp(name, "Execute"))
+    return CMD_QUERY;
+  if (!strcmp(name, "Init DB"))
+    return CMD_INIT_DB;
+  if (!strcmp(name, "Change user"))
+    return CMD_CHANGE_USER;
+  return CMD_OTHER;
+}
+
+/* splits a record line, false for continuation and header lines */
+static bool parse_record(char *line, log_event *event)
+{
+  char *p= line;
+
+  /* "150518 12:00:01\t" or "2015-05-18T12:00:01.123456Z\t" */
+  if (isdigit((uchar) *p))
+  {
+    p= strchr(p, '\t');
+    if (!p)
+      return false;
+  }
+  p= skip_space(p);
+  if (!isdigit((uchar) *p))
+    return false;
+
+  char *end;
+  ulong id= strtoul(p, &end, 10);
+  if (*end != ' ')
+    return false;
+
+  char *name= end + 1;
+  char *tab= strchr(name, '\t');
+  if (!tab)
+  {
+    /* "Quit" has no argument and sometimes no tab */
+    tab= name + strlen(name);
+    if (tab == name)
+      return false;
+  }
+  else
+    *tab++= 0;
+
+  event->thread_id= id;
+  event->name= strdup(name);
+  event->command= command_of(event->name);
+  event->argument= strdup(tab);
+  event->argument_length= strlen(event->argument);
+  return true;
+}
+
+static bool keyword(const char *p, const char *word)
+{
+  size_t len= strlen(word);
+  return !strncasecmp(p, word, len) && !isalnum((uchar) p[len]) && p[len] != '_';
+}
+
+static enum_sql_command sql_command_of(const char *q)
+{
+  while (isspace((uchar) *q) || *q == '(')
+    q++;
+  if (keyword(q, "SELECT"))
+    return SQLCOM_SELECT;
+  if (keyword(q, "INSERT"))
+    return strcasestr(q, "SELECT") ? SQLCOM_INSERT_SELECT : SQLCOM_INSERT;
+  if (keyword(q, "REPLACE"))
+    return strcasestr(q, "SELECT") ? SQLCOM_REPLACE_SELECT : SQLCOM_REPLACE;
+  if (keyword(q, "UPDATE"))
+    return SQLCOM_UPDATE;
+  if (keyword(q, "DELETE"))
+    return SQLCOM_DELETE;
+  if (keyword(q, "CREATE"))
+    return SQLCOM_CREATE_TABLE;
+  if (keyword(q, "ALTER"))
+    return SQLCOM_ALTER_TABLE;
+  if (keyword(q, "DROP"))
+    return SQLCOM_DROP_TABLE;
+  if (keyword(q, "TRUNCATE"))
+    return SQLCOM_TRUNCATE;
+  if (keyword(q, "SHOW"))
+    return SQLCOM_SHOW_VARIABLES;
+  if (keyword(q, "SET"))
+    return SQLCOM_SET_OPTION;
+  if (keyword(q, "CALL"))
+    return SQLCOM_CALL;
+  if (keyword(q, "LOAD"))
+    return SQLCOM_LOAD;
+  if (keyword(q, "LOCK"))
+    return SQLCOM_LOCK_TABLES;
+  if (keyword(q, "UNLOCK"))
+    return SQLCOM_UNLOCK_TABLES;
+  return SQLCOM_END;
+}
+
+/* reads `name` or name, returns the position after it */
+static const char *read_identifier(const char *p, char *out, size_t size)
+{
+  size_t len= 0;
+  if (*p == '`')
+  {
+    for (p++; *p && *p != '`'; p++)
+      if (len < size - 1)
+        out[len++]= *p;
+    if (*p == '`')
+      p++;
+  }
+  else
+    for (; isalnum((uchar) *p) || *p == '_' || *p == '$'; p++)
+      if (len < size - 1)
+        out[len++]= *p;
+  out[len]= 0;
+  return p;
+}
+
+static void add_table(LEX *lex, TABLE_LIST **last, const char *default_db,
+                      const char *db, const char *name, thr_lock_type lock_type)
+{
+  TABLE_LIST *table= new TABLE_LIST();
+  table->db= strdup(*db ? db : default_db);
+  table->db_length= strlen(table->db);
+  table->table_name= table->alias= strdup(name);
+  table->table_name_length= strlen(name);
+  table->lock_type= lock_type;
+  if (*last)
+    (*last)->next_local= table;
+  else
+    lex->query_tables= table;
+  *last= table;
+}
+
+static void analyze_query(log_event *event, const char *default_db)
+{
+  static const char *markers[]= { "FROM", "JOIN", "INTO", "UPDATE", "TABLE", NULL };
+  LEX *lex= &event->lex;
+  TABLE_LIST *last= NULL;
+  const char *q= event->argument;
+  bool writes;
+
+  lex->sql_command= sql_command_of(q);
+  lex->query_tables= NULL;
+  writes= lex->sql_command != SQLCOM_SELECT &&
+          lex->sql_command != SQLCOM_SHOW_VARIABLES &&
+          lex->sql_command != SQLCOM_SET_OPTION &&
+          lex->sql_command != SQLCOM_END;
+
+  for (const char *p= q; *p; p++)
+  {
+    if (p != q && (isalnum((uchar) p[-1]) || p[-1] == '_'))
+      continue;
+
+    int m;
+    for (m= 0; markers[m] && !keyword(p, markers[m]); m++)
+      ;
+    if (!markers[m])
+      continue;
+
+    /* the target of a write is the first table, the rest are read */
+    thr_lock_type lock_type= writes && !last ? TL_WRITE : TL_READ;
+    p+= strlen(markers[m]);
+    for (;;)
+    {
+      char first[NAME_LEN + 1], second[NAME_LEN + 1];
+      p= (const char*) skip_space((char*) p);
+      const char *after= read_identifier(p, first, sizeof(first));
+      if (!*first || keyword(p, "SELECT"))
+        break;
+      if (*after == '.')
+      {
+        after= read_identifier(after + 1, second, sizeof(second));
+        add_table(lex, &last, default_db, first, second, lock_type);
+      }
+      else
+        add_table(lex, &last, default_db, "", first, lock_type);
+      p= (const char*) skip_space((char*) after);
+
+      /* FROM a, b: skip an alias, continue after a comma */
+      if (isalpha((uchar) *p) && !keyword(p, "WHERE") && !keyword(p, "JOIN") &&
+          !keyword(p, "SET") && !keyword(p, "VALUES") && !keyword(p, "ON"))
+      {
+        char alias[NAME_LEN + 1];
+        p= (const char*) skip_space((char*) read_identifier(p, alias, sizeof(alias)));
+      }
+      if (*p != ',' || m != 0)
+        break;
+      p++;
+    }
+    if (!*p)
+      break;
+  }
+}
+
+bool parse_connect(const log_event &event, char *user, char *host,
+                   char *db, size_t size)
+{
+  /* "user@host on db" or "user@host on db using TCP/IP" */
+  const char *at= strchr(event.argument, '@');
+  const char *on= strstr(event.argument, " on ");
+  if (!at || !on || at > on)
+    return false;
+
+  snprintf(user, size, "%.*s", (int) (at - event.argument), event.argument);
+  snprintf(host, size, "%.*s", (int) (on - at - 1), at + 1);
+  const char *name= on + 4;
+  const char *using_= strstr(name, " using ");
+  snprintf(db, size, "%.*s", (int) (using_ ? using_ - name : strlen(name)), name);
+  return true;
+}
+
+bool read_general_log(const char *path, std::vector<log_event> &events)
+{
+  FILE *file= fopen(path, "r");
+  char *line= NULL;
+  size_t capacity= 0;
+  ssize_t len;
+
+  if (!file)
+    return false;
+
+  while ((len= getline(&line, &capacity, file)) > 0)
+  {
+    if (line[len - 1] == '\n')
+      line[--len]= 0;
+
+    log_event event;
+    memset(&event, 0, sizeof(event));
+    if (parse_record(line, &event))
+      events.push_back(event);
+    else if (!events.empty())
+    {
+      /* continuation of a multi-line argument */
+      log_event &prev= events.back();
+      size_t add= strlen(line);
+      prev.argument= (char*) realloc(prev.argument, prev.argument_length + add + 2);
+      prev.argument[prev.argument_length++]= '\n';
+      memcpy(prev.argument + prev.argument_length, line, add + 1);
+      prev.argument_length+= add;
+    }
+  }
+  free(line);
+  fclose(file);
+
+  /* the current database of each connection qualifies bare table names */
+  std::vector<std::pair<ulong, const char*> > current_db;
+  for (size_t i= 0; i < events.size(); i++)
+  {
+    log_event &event= events[i];
+    const char *db= "";
+    size_t j;
+    for (j= 0; j < current_db.size() && current_db[j].first != event.thread_id; j++)
+      ;
+    if (j == current_db.size())
+      current_db.push_back(std::make_pair(event.thread_id, ""));
+
+    if (event.command == CMD_INIT_DB)
+      current_db[j].second= event.argument;
+    else if (event.command == CMD_CONNECT)
+    {
+      char user[256], host[256], name[256];
+      if (parse_connect(event, user, host, name, sizeof(name)))
+        current_db[j].second= strdup(name);
+    }
+    db= current_db[j].second;
+    if (event.command == CMD_QUERY)
+      analyze_query(&event, db);
+  }
+  return true;
+}
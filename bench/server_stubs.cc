@@ -0,0 +1,183 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: server globals and services the plugins call into.
+
+   syslog() is replaced by a version that formats the message and drops
+   it, so the cost of building audit lines is measured without a
+   syslog daemon in the way.
+*/
+#include "bench.h"
+#include "mysqld.h"
+#include "set_var.h"
+#include "sql_plugin.h"
+#include "sql_cache.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <syslog.h>
+
+static CHARSET_INFO bench_charset= { "utf8" };
+CHARSET_INFO *system_charset_info= &bench_charset;
+
+char mysql_real_data_home[FN_REFLEN]= ".";
+char *mysql_tmpdir= (char*) "/tmp";
+char opt_plugin_dir[FN_REFLEN]= ".";
+
+mysql_rwlock_t LOCK_system_variables_hash= PTHREAD_RWLOCK_INITIALIZER;
+
+sys_var *intern_find_sys_var(const char *str, uint length)
+{
+  return NULL;
+}
+
+Query_cache query_cache;
+
+volatile long long syslog_lines;
+__thread ulonglong stored_rows;
+void (*bench_record_hook)(TABLE *table);
+
+bool schema_table_store_record(THD *thd, TABLE *table)
+{
+  stored_rows++;
+  if (bench_record_hook)
+    bench_record_hook(table);
+  return false;
+}
+
+/* Field that keeps the last value like a record buffer would */
+class bench_field : public Field
+{
+  char buf[1024];
+  double real;
+  longlong integer;
+public:
+  int store(const char *to, uint length, CHARSET_INFO *cs)
+  {
+    memcpy(buf, to, min(length, (uint) sizeof(buf)));
+    return 0;
+  }
+  int store(double nr) { real= nr; return 0; }
+  int store(longlong nr, bool unsigned_val) { integer= nr; return 0; }
+  longlong stored_integer() const { return integer; }
+};
+
+longlong bench_field_integer(Field *field)
+{
+  return ((bench_field*) field)->stored_integer();
+}
+
+TABLE *bench_table_new(uint fields)
+{
+  TABLE *table= new TABLE;
+  table->fields= fields;
+  table->field= new Field*[fields];
+  for (uint i= 0; i < fields; i++)
+    table->field[i]= new bench_field;
+  return table;
+}
+
+/* reaches the protected hashes the way the query cache plugins do */
+class bench_query_cache : public Query_cache
+{
+public:
+  void fill(uint query_count, uint result_blocks, uint table_count);
+};
+
+void bench_query_cache::fill(uint query_count, uint result_blocks, uint table_count)
+{
+  pthread_mutex_init(&structure_guard_mutex, NULL);
+
+  this->queries.records= query_count;
+  this->queries.elements= new uchar*[query_count];
+  for (uint i= 0; i < query_count; i++)
+  {
+    Query_cache_block *block= new Query_cache_block();
+    Query_cache_query *query= new Query_cache_query();
+    char text[128];
+    snprintf(text, sizeof(text), "SELECT * FROM t%u WHERE id = %u", i % max(table_count, 1U), i);
+    query->text= strdup(text);
+    query->limit_found_rows= i;
+
+    /* results are a circular list of blocks */
+    Query_cache_block *first= NULL, *last= NULL;
+    for (uint j= 0; j < result_blocks; j++)
+    {
+      Query_cache_block *result= new Query_cache_block();
+      result->type= Query_cache_block::RESULT;
+      result->length= 4096;
+      result->used= 1000 + j;
+      if (!first)
+        first= result;
+      else
+        last->next= result;
+      last= result;
+    }
+    if (last)
+      last->next= first;
+    query->res= first;
+
+    block->type= Query_cache_block::QUERY;
+    block->query_data= query;
+    this->queries.elements[i]= (uchar*) block;
+  }
+
+  this->tables.records= table_count;
+  this->tables.elements= new uchar*[table_count];
+  for (uint i= 0; i < table_count; i++)
+  {
+    Query_cache_block *block= new Query_cache_block();
+    Query_cache_table *table= new Query_cache_table();
+    char name[64];
+    snprintf(name, sizeof(name), "t%u", i);
+    table->db_name= strdup("bench");
+    table->table_name= strdup(name);
+    block->type= Query_cache_block::TABLE;
+    block->table_data= table;
+    this->tables.elements[i]= (uchar*) block;
+  }
+}
+
+void bench_query_cache_fill(uint queries, uint result_blocks, uint tables)
+{
+  ((bench_query_cache*) &query_cache)->fill(queries, result_blocks, tables);
+}
+
+/*
+  syslog replacement
+*/
+extern "C" void openlog(const char *ident, int option, int facility)
+{
+}
+
+extern "C" void closelog(void)
+{
+}
+
+extern "C" void vsyslog(int priority, const char *format, va_list ap)
+{
+  static __thread char line[2048];
+  vsnprintf(line, sizeof(line), format, ap);
+  __sync_add_and_fetch(&syslog_lines, 1);
+}
+
+extern "C" void syslog(int priority, const char *format, ...)
+{
+  va_list ap;
+  va_start(ap, format);
+  vsyslog(priority, format, ap);
+  va_end(ap);
+}
+
+/* what syslog() compiles to with _FORTIFY_SOURCE */
+extern "C" void __vsyslog_chk(int priority, int flag, const char *format, va_list ap)
+{
+  vsyslog(priority, format, ap);
+}
+
+extern "C" void __syslog_chk(int priority, int flag, const char *format, ...)
+{
+  va_list ap;
+  va_start(ap, format);
+  vsyslog(priority, format, ap);
+  va_end(ap);
+}
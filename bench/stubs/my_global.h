@@ -0,0 +1,38 @@
+#ifndef STUB_MY_GLOBAL_H
+#define STUB_MY_GLOBAL_H
+/*
+  Stand-in for include/my_global.h: basic types and macros of 5.5.
+*/
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <errno.h>
+#define MYSQL_VERSION_ID 50541
+typedef unsigned char uchar;
+typedef unsigned int uint;
+typedef unsigned long ulong;
+typedef unsigned long long ulonglong;
+typedef long long longlong;
+typedef long long int64;
+typedef char my_bool;
+typedef ulong my_thread_id;
+typedef longlong query_id_t;
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#define FN_REFLEN 512
+#define NAME_LEN 64
+#define USERNAME_CHAR_LENGTH 16
+#define USERNAME_LENGTH (USERNAME_CHAR_LENGTH * 3)
+#define HOSTNAME_LENGTH 60
+#define array_elements(A) ((uint) (sizeof(A) / sizeof(A[0])))
+#define STRING_WITH_LEN(X) (X), ((size_t) (sizeof(X) - 1))
+#endif
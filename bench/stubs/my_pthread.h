@@ -0,0 +1,2 @@
+/* Stand-in for include/my_pthread.h. */
+#include "my_global.h"
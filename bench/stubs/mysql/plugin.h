@@ -0,0 +1,166 @@
+#ifndef STUB_MYSQL_PLUGIN_H
+#define STUB_MYSQL_PLUGIN_H
+/*
+  Stand-in for include/mysql/plugin.h.
+*/
+#ifdef __cplusplus
+class THD;
+#define MYSQL_THD THD*
+#else
+#define MYSQL_THD void*
+#endif
+typedef void *MYSQL_PLUGIN;
+#include <stddef.h>
+#include <stdlib.h>
+#include "../typelib.h"
+
+#define MYSQL_UDF_PLUGIN             0
+#define MYSQL_STORAGE_ENGINE_PLUGIN  1
+#define MYSQL_FTPARSER_PLUGIN        2
+#define MYSQL_DAEMON_PLUGIN          3
+#define MYSQL_INFORMATION_SCHEMA_PLUGIN  4
+#define MYSQL_AUDIT_PLUGIN           5
+#define MYSQL_REPLICATION_PLUGIN     6
+#define MYSQL_AUTHENTICATION_PLUGIN  7
+#define PLUGIN_LICENSE_PROPRIETARY 0
+#define PLUGIN_LICENSE_GPL 1
+#define PLUGIN_LICENSE_BSD 2
+
+#define MYSQL_DAEMON_INTERFACE_VERSION 0x0100
+#define MYSQL_INFORMATION_SCHEMA_INTERFACE_VERSION 0x0100
+
+enum enum_mysql_show_type
+{
+  SHOW_UNDEF, SHOW_BOOL, SHOW_INT, SHOW_LONG,
+  SHOW_LONGLONG, SHOW_CHAR, SHOW_CHAR_PTR,
+  SHOW_ARRAY, SHOW_FUNC, SHOW_DOUBLE
+};
+
+struct st_mysql_show_var {
+  const char *name;
+  char *value;
+  enum enum_mysql_show_type type;
+};
+
+#define SHOW_VAR_FUNC_BUFF_SIZE 1024
+typedef int (*mysql_show_var_func)(MYSQL_THD, struct st_mysql_show_var*, char *);
+
+#define PLUGIN_VAR_BOOL         0x0001
+#define PLUGIN_VAR_INT          0x0002
+#define PLUGIN_VAR_LONG         0x0003
+#define PLUGIN_VAR_LONGLONG     0x0004
+#define PLUGIN_VAR_STR          0x0005
+#define PLUGIN_VAR_ENUM         0x0006
+#define PLUGIN_VAR_SET          0x0007
+#define PLUGIN_VAR_UNSIGNED     0x0080
+#define PLUGIN_VAR_THDLOCAL     0x0100
+#define PLUGIN_VAR_READONLY     0x0200
+#define PLUGIN_VAR_NOSYSVAR     0x0400
+#define PLUGIN_VAR_NOCMDOPT     0x0800
+#define PLUGIN_VAR_NOCMDARG     0x1000
+#define PLUGIN_VAR_RQCMDARG     0x0000
+#define PLUGIN_VAR_OPCMDARG     0x2000
+#define PLUGIN_VAR_MEMALLOC     0x8000
+
+struct st_mysql_sys_var;
+struct st_mysql_value;
+
+typedef int (*mysql_var_check_func)(MYSQL_THD thd, struct st_mysql_sys_var *var,
+                                    void *save, struct st_mysql_value *value);
+typedef void (*mysql_var_update_func)(MYSQL_THD thd, struct st_mysql_sys_var *var,
+                                      void *var_ptr, const void *save);
+
+/*
+  Simplified system variable: the bench assigns def_val/def_str, or a
+  value given with --set, to *value before the plugin is initialized.
+*/
+struct st_mysql_sys_var {
+  int flags;
+  const char *name;
+  const char *comment;
+  mysql_var_check_func check;
+  mysql_var_update_func update;
+  void *value;
+  long long def_val;
+  const char *def_str;
+  TYPELIB *typelib;
+  unsigned long thd_slot;
+};
+
+#define MYSQL_SYSVAR_NAME(name) mysql_sysvar_ ## name
+#define MYSQL_SYSVAR(name) (&(MYSQL_SYSVAR_NAME(name)))
+
+#define MYSQL_SYSVAR_BOOL(name, varname, opt, comment, check, update, def) \
+struct st_mysql_sys_var MYSQL_SYSVAR_NAME(name)= \
+{ PLUGIN_VAR_BOOL | (opt), #name, comment, check, update, &varname, def, 0, 0 }
+#define MYSQL_SYSVAR_STR(name, varname, opt, comment, check, update, def) \
+struct st_mysql_sys_var MYSQL_SYSVAR_NAME(name)= \
+{ PLUGIN_VAR_STR | (opt), #name, comment, check, update, &varname, 0, def, 0 }
+#define MYSQL_SYSVAR_INT(name, varname, opt, comment, check, update, def, min, max, blk) \
+struct st_mysql_sys_var MYSQL_SYSVAR_NAME(name)= \
+{ PLUGIN_VAR_INT | (opt), #name, comment, check, update, &varname, def, 0, 0 }
+#define MYSQL_SYSVAR_UINT(name, varname, opt, comment, check, update, def, min, max, blk) \
+struct st_mysql_sys_var MYSQL_SYSVAR_NAME(name)= \
+{ PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | (opt), #name, comment, check, update, &varname, def, 0, 0 }
+#define MYSQL_SYSVAR_LONG(name, varname, opt, comment, check, update, def, min, max, blk) \
+struct st_mysql_sys_var MYSQL_SYSVAR_NAME(name)= \
+{ PLUGIN_VAR_LONG | (opt), #name, comment, check, update, &varname, def, 0, 0 }
+#define MYSQL_SYSVAR_ULONG(name, varname, opt, comment, check, update, def, min, max, blk) \
+struct st_mysql_sys_var MYSQL_SYSVAR_NAME(name)= \
+{ PLUGIN_VAR_LONG | PLUGIN_VAR_UNSIGNED | (opt), #name, comment, check, update, &varname, def, 0, 0 }
+#define MYSQL_SYSVAR_LONGLONG(name, varname, opt, comment, check, update, def, min, max, blk) \
+struct st_mysql_sys_var MYSQL_SYSVAR_NAME(name)= \
+{ PLUGIN_VAR_LONGLONG | (opt), #name, comment, check, update, &varname, def, 0, 0 }
+#define MYSQL_SYSVAR_ULONGLONG(name, varname, opt, comment, check, update, def, min, max, blk) \
+struct st_mysql_sys_var MYSQL_SYSVAR_NAME(name)= \
+{ PLUGIN_VAR_LONGLONG | PLUGIN_VAR_UNSIGNED | (opt), #name, comment, check, update, &varname, def, 0, 0 }
+#define MYSQL_SYSVAR_ENUM(name, varname, opt, comment, check, update, def, typelib) \
+struct st_mysql_sys_var MYSQL_SYSVAR_NAME(name)= \
+{ PLUGIN_VAR_ENUM | (opt), #name, comment, check, update, &varname, def, 0, typelib }
+
+/* session variables share one slot across all THDs in the bench */
+#define MYSQL_THDVAR_ENUM(name, opt, comment, check, update, def, typelib) \
+struct st_mysql_sys_var MYSQL_SYSVAR_NAME(name)= \
+{ PLUGIN_VAR_ENUM | PLUGIN_VAR_THDLOCAL | (opt), #name, comment, check, update, \
+  &MYSQL_SYSVAR_NAME(name).thd_slot, def, 0, typelib }
+#define MYSQL_THDVAR_ULONG(name, opt, comment, check, update, def, min, max, blk) \
+struct st_mysql_sys_var MYSQL_SYSVAR_NAME(name)= \
+{ PLUGIN_VAR_LONG | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_THDLOCAL | (opt), #name, comment, \
+  check, update, &MYSQL_SYSVAR_NAME(name).thd_slot, def, 0, 0 }
+#define THDVAR(thd, name) (MYSQL_SYSVAR_NAME(name).thd_slot)
+
+struct st_mysql_plugin
+{
+  int type;
+  void *info;
+  const char *name;
+  const char *author;
+  const char *descr;
+  int license;
+  int (*init)(void *);
+  int (*deinit)(void *);
+  unsigned int version;
+  struct st_mysql_show_var *status_vars;
+  struct st_mysql_sys_var **system_vars;
+  void * __reserved1;
+  unsigned long flags;
+};
+
+/*
+  Each plugin library gets its own descriptor array, so several can be
+  linked into one bench binary, like builtin plugins are into mysqld.
+*/
+#ifdef __cplusplus
+#define BENCH_EXTERN_C extern "C"
+#else
+#define BENCH_EXTERN_C
+#endif
+#define mysql_declare_plugin(NAME) \
+BENCH_EXTERN_C struct st_mysql_plugin bench_ ## NAME ## _plugin[]; \
+struct st_mysql_plugin bench_ ## NAME ## _plugin[]= {
+#define mysql_declare_plugin_end ,{0,0,0,0,0,0,0,0,0,0,0,0,0}}
+
+struct st_mysql_daemon { int interface_version; };
+struct st_mysql_information_schema { int interface_version; };
+
+#endif
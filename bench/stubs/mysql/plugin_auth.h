@@ -0,0 +1,27 @@
+#ifndef STUB_PLUGIN_AUTH_H
+#define STUB_PLUGIN_AUTH_H
+/*
+  Stand-in for include/mysql/plugin_auth.h.
+*/
+#include <mysql/plugin.h>
+#include <mysql/plugin_auth_common.h>
+#define MYSQL_AUTHENTICATION_INTERFACE_VERSION 0x0100
+typedef struct st_mysql_server_auth_info
+{
+  char *user_name;
+  unsigned int user_name_length;
+  const char *auth_string;
+  unsigned long auth_string_length;
+  char authenticated_as[MYSQL_USERNAME_LENGTH+1];
+  char external_user[512];
+  int  password_used;
+  const char *host_or_ip;
+  unsigned int host_or_ip_length;
+} MYSQL_SERVER_AUTH_INFO;
+struct st_mysql_auth
+{
+  int interface_version;
+  const char *client_auth_plugin;
+  int (*authenticate_user)(MYSQL_PLUGIN_VIO *vio, MYSQL_SERVER_AUTH_INFO *info);
+};
+#endif
@@ -0,0 +1,21 @@
+#ifndef STUB_PLUGIN_AUTH_COMMON_H
+#define STUB_PLUGIN_AUTH_COMMON_H
+/*
+  Stand-in for include/mysql/plugin_auth_common.h.
+*/
+#define MYSQL_USERNAME_LENGTH 48
+#define CR_ERROR 0
+#define CR_OK -1
+#define CR_OK_HANDSHAKE_COMPLETE -2
+typedef struct st_plugin_vio_info {
+  enum { MYSQL_VIO_INVALID, MYSQL_VIO_TCP, MYSQL_VIO_SOCKET,
+         MYSQL_VIO_PIPE, MYSQL_VIO_MEMORY } protocol;
+  int socket;
+} MYSQL_PLUGIN_VIO_INFO;
+typedef struct st_plugin_vio
+{
+  int (*read_packet)(struct st_plugin_vio *vio, unsigned char **buf);
+  int (*write_packet)(struct st_plugin_vio *vio, const unsigned char *packet, int packet_len);
+  void (*info)(struct st_plugin_vio *vio, struct st_plugin_vio_info *info);
+} MYSQL_PLUGIN_VIO;
+#endif
@@ -0,0 +1,9 @@
+#ifndef STUB_MYSQLD_H
+#define STUB_MYSQLD_H
+/*
+  Stand-in for sql/mysqld.h: the globals the plugins read.
+*/
+#include "my_global.h"
+extern char mysql_real_data_home[];
+extern char *mysql_tmpdir;
+#endif
@@ -0,0 +1,2 @@
+/* Stand-in for security/pam_modules.h. */
+#include "pam_appl.h"
@@ -0,0 +1,19 @@
+#ifndef STUB_SET_VAR_H
+#define STUB_SET_VAR_H
+/*
+  Stand-in for sql/set_var.h: server system variable lookup.
+*/
+#include "sql_class.h"
+enum enum_var_type { OPT_DEFAULT= 0, OPT_SESSION, OPT_GLOBAL };
+class sys_var
+{
+public:
+  virtual ~sys_var() {}
+  virtual uchar *value_ptr(THD *thd, enum_var_type type, LEX_STRING *base)= 0;
+};
+typedef pthread_rwlock_t mysql_rwlock_t;
+#define mysql_rwlock_rdlock(L) pthread_rwlock_rdlock(L)
+#define mysql_rwlock_unlock(L) pthread_rwlock_unlock(L)
+extern mysql_rwlock_t LOCK_system_variables_hash;
+sys_var *intern_find_sys_var(const char *str, uint length);
+#endif
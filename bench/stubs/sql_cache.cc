@@ -0,0 +1,5 @@
+/*
+  Stand-in for sql/sql_cache.cc: the query cache plugins include the
+  server source file directly to reach the protected hashes.
+*/
+#include "sql_cache.h"
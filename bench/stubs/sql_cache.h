@@ -0,0 +1,74 @@
+#ifndef STUB_SQL_CACHE_H
+#define STUB_SQL_CACHE_H
+/*
+  Stand-in for sql/sql_cache.h.
+*/
+#include "sql_class.h"
+
+typedef struct st_hash
+{
+  ulong records;
+  uchar **elements;
+} HASH;
+
+static inline uchar *my_hash_element(HASH *hash, ulong idx)
+{
+  return idx < hash->records ? hash->elements[idx] : NULL;
+}
+
+struct Query_cache_query;
+struct Query_cache_table;
+
+struct Query_cache_block
+{
+  enum block_type {FREE, QUERY, RESULT, RES_CONT, RES_BEG,
+                   RES_INCOMPLETE, TABLE, INCOMPLETE};
+  ulong length;
+  ulong used;
+  Query_cache_block *pnext, *pprev, *next, *prev;
+  block_type type;
+  Query_cache_query *query_data;
+  Query_cache_table *table_data;
+
+  Query_cache_query *query() { return query_data; }
+  Query_cache_table *table() { return table_data; }
+};
+
+struct Query_cache_query
+{
+  ulonglong limit_found_rows;
+  Query_cache_block *res;
+  char *text;
+
+  char *query() { return text; }
+  ulonglong found_rows() { return limit_found_rows; }
+  Query_cache_block *result() { return res; }
+};
+
+struct Query_cache_table
+{
+  char *db_name;
+  char *table_name;
+
+  char *db() { return db_name; }
+  char *table() { return table_name; }
+};
+
+class Query_cache
+{
+public:
+  ulong query_cache_size, query_cache_limit;
+  ulong free_memory, queries_in_cache, hits, inserts, refused,
+        free_memory_blocks, total_blocks, lowmem_prunes;
+
+  void lock(void) { pthread_mutex_lock(&structure_guard_mutex); }
+  void unlock(void) { pthread_mutex_unlock(&structure_guard_mutex); }
+
+protected:
+  pthread_mutex_t structure_guard_mutex;
+  HASH queries, tables;
+};
+
+extern Query_cache query_cache;
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef STUB_SQL_CLASS_H
+#define STUB_SQL_CLASS_H
+/*
+  Lightweight stand-ins for the server classes the plugins touch.
+  Only the members the plugins actually read are declared.
+*/
+#include "my_global.h"
+#include <mysql/plugin.h>
+#include <sys/time.h>
+
+typedef struct charset_info_st { const char *name; } CHARSET_INFO;
+extern CHARSET_INFO *system_charset_info;
+
+typedef struct st_mysql_lex_string { char *str; size_t length; } LEX_STRING;
+
+enum enum_field_types { MYSQL_TYPE_DECIMAL, MYSQL_TYPE_TINY,
+                        MYSQL_TYPE_SHORT,  MYSQL_TYPE_LONG,
+                        MYSQL_TYPE_FLOAT,  MYSQL_TYPE_DOUBLE,
+                        MYSQL_TYPE_NULL,   MYSQL_TYPE_TIMESTAMP,
+                        MYSQL_TYPE_LONGLONG,MYSQL_TYPE_INT24,
+                        MYSQL_TYPE_DATE,   MYSQL_TYPE_TIME,
+                        MYSQL_TYPE_DATETIME, MYSQL_TYPE_YEAR,
+                        MYSQL_TYPE_NEWDATE, MYSQL_TYPE_VARCHAR,
+                        MYSQL_TYPE_BIT,
+                        MYSQL_TYPE_NEWDECIMAL=246,
+                        MYSQL_TYPE_ENUM=247,
+                        MYSQL_TYPE_SET=248,
+                        MYSQL_TYPE_TINY_BLOB=249,
+                        MYSQL_TYPE_MEDIUM_BLOB=250,
+                        MYSQL_TYPE_LONG_BLOB=251,
+                        MYSQL_TYPE_BLOB=252,
+                        MYSQL_TYPE_VAR_STRING=253,
+                        MYSQL_TYPE_STRING=254,
+                        MYSQL_TYPE_GEOMETRY=255 };
+
+enum thr_lock_type { TL_IGNORE=-1,
+                     TL_UNLOCK,
+                     TL_READ_DEFAULT,
+                     TL_READ,
+                     TL_READ_WITH_SHARED_LOCKS,
+                     TL_READ_HIGH_PRIORITY,
+                     TL_READ_NO_INSERT,
+                     TL_WRITE_ALLOW_WRITE,
+                     TL_WRITE_CONCURRENT_INSERT,
+                     TL_WRITE_DELAYED,
+                     TL_WRITE_DEFAULT,
+                     TL_WRITE_LOW_PRIORITY,
+                     TL_WRITE,
+                     TL_WRITE_ONLY };
+
+enum enum_sql_command {
+  SQLCOM_SELECT, SQLCOM_CREATE_TABLE, SQLCOM_CREATE_INDEX, SQLCOM_ALTER_TABLE,
+  SQLCOM_UPDATE, SQLCOM_INSERT, SQLCOM_INSERT_SELECT,
+  SQLCOM_DELETE, SQLCOM_TRUNCATE, SQLCOM_DROP_TABLE, SQLCOM_DROP_INDEX,
+  SQLCOM_SHOW_DATABASES, SQLCOM_SHOW_TABLES, SQLCOM_SHOW_FIELDS,
+  SQLCOM_SHOW_KEYS, SQLCOM_SHOW_VARIABLES, SQLCOM_SHOW_STATUS,
+  SQLCOM_LOAD, SQLCOM_SET_OPTION, SQLCOM_LOCK_TABLES, SQLCOM_UNLOCK_TABLES,
+  SQLCOM_REPLACE, SQLCOM_REPLACE_SELECT,
+  SQLCOM_DELETE_MULTI, SQLCOM_UPDATE_MULTI,
+  SQLCOM_CALL, SQLCOM_END
+};
+
+class Field
+{
+public:
+  virtual ~Field() {}
+  virtual int store(const char *to, uint length, CHARSET_INFO *cs)= 0;
+  virtual int store(double nr)= 0;
+  virtual int store(longlong nr, bool unsigned_val)= 0;
+  void set_null() { null_flag= true; }
+  void set_notnull() { null_flag= false; }
+  bool null_flag;
+};
+
+typedef struct st_table { Field **field; uint fields; } TABLE;
+
+struct TABLE_LIST
+{
+  TABLE_LIST *next_local;
+  char *db, *alias, *table_name;
+  size_t db_length, table_name_length;
+  TABLE *table;
+  thr_lock_type lock_type;
+};
+
+class Item {};
+typedef Item COND;
+
+typedef struct st_lex
+{
+  enum_sql_command sql_command;
+  TABLE_LIST *query_tables;
+} LEX;
+
+/* my_sys.h */
+static inline ulonglong my_micro_time()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (ulonglong) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+class Security_context
+{
+public:
+  char *host, *user, *ip;
+  const char *host_or_ip;
+  char *priv_user;
+};
+
+class THD
+{
+public:
+  Security_context main_security_ctx;
+  LEX *lex;
+  char *db;
+  uint db_length;
+  my_thread_id thread_id;
+  query_id_t query_id;
+  ulonglong thr_create_utime;
+  longlong m_row_count_func;
+  longlong get_row_count_func() const { return m_row_count_func; }
+};
+
+#define MY_I_S_MAYBE_NULL 1
+#define MY_I_S_UNSIGNED   2
+#define SKIP_OPEN_TABLE 0
+
+typedef struct st_field_info
+{
+  const char* field_name;
+  uint field_length;
+  enum enum_field_types field_type;
+  int value;
+  uint field_flags;
+  const char* old_name;
+  uint open_method;
+} ST_FIELD_INFO;
+
+typedef struct st_schema_table
+{
+  const char* table_name;
+  ST_FIELD_INFO *fields_info;
+  TABLE *(*create_table)  (THD *thd, TABLE_LIST *table_list);
+#if MYSQL_VERSION_ID > 50600
+  int (*fill_table) (THD *thd, TABLE_LIST *tables, Item *cond);
+#else
+  int (*fill_table) (THD *thd, TABLE_LIST *tables, COND *cond);
+#endif
+} ST_SCHEMA_TABLE;
+
+#endif
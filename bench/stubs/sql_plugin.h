@@ -0,0 +1,8 @@
+#ifndef STUB_SQL_PLUGIN_H
+#define STUB_SQL_PLUGIN_H
+/*
+  Stand-in for sql/sql_plugin.h.
+*/
+#include "my_global.h"
+extern char opt_plugin_dir[FN_REFLEN];
+#endif
@@ -0,0 +1,2 @@
+/* Stand-in for sql/sql_priv.h. */
+#include "my_global.h"
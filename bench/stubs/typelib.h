@@ -0,0 +1,12 @@
+#ifndef STUB_TYPELIB_H
+#define STUB_TYPELIB_H
+/*
+  Stand-in for include/typelib.h.
+*/
+typedef struct st_typelib {
+  unsigned int count;
+  const char *name;
+  const char **type_names;
+  unsigned int *type_lengths;
+} TYPELIB;
+#endif
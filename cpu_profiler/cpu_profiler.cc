@@ -0,0 +1,737 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: sampling CPU profiler with folded stacks in
+                INFORMATION_SCHEMA.CPU_PROFILE.
+
+   Every mysqld thread gets a POSIX timer on its own CPU-time clock, so
+   SIGPROF is delivered to a thread only while it burns CPU.  The signal
+   handler unwinds the stack into a preallocated ring and never allocates
+   or locks; a background thread folds the ring into a table of unique
+   stacks, and symbols are resolved only when the table is read.
+
+   The handler walks frame pointers from the interrupted context, so
+   stacks are as deep as the code keeps frame pointers: build mysqld
+   with -fno-omit-frame-pointer for complete stacks.
+*/
+#include "sql_class.h"                          // TABLE
+#include <mysql/plugin.h>
+#include "my_global.h"                          //
+
+#include <dirent.h>
+#include <dlfcn.h>                              // dladdr
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>                            // process_vm_readv
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <cxxabi.h>                             // __cxa_demangle
+
+bool schema_table_store_record(THD *thd,TABLE *table);
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/* CPU-time clock of another thread, see MAKE_THREAD_CPUCLOCK in the kernel */
+#define THREAD_CPU_CLOCK(tid) ((~(clockid_t) (tid) << 3) | 6)
+
+#define MAX_STACK_DEPTH 48
+#define MAX_FRAME_SIZE (1024 * 1024)            /* larger steps end the walk */
+#define SAMPLE_RING_SIZE 4096                   /* power of two */
+#define MAX_UNIQUE_STACKS 8192                  /* power of two */
+#define MAX_PROFILED_THREADS 1024
+#define MAX_FOLDED_STACK_LENGTH 16384
+#define DRAIN_INTERVAL_MS 100
+#define RESCAN_INTERVAL_MS 1000
+
+enum sample_state { SAMPLE_FREE= 0, SAMPLE_WRITING, SAMPLE_READY };
+
+struct stack_sample
+{
+  volatile int state;
+  int depth;
+  void *frames[MAX_STACK_DEPTH];
+};
+
+struct stack_entry
+{
+  ulonglong count;
+  uint hash;
+  int depth;
+  void *frames[MAX_STACK_DEPTH];
+};
+
+struct profiled_thread
+{
+  pid_t tid;
+  timer_t timer;
+  bool seen;
+};
+
+/* static counters for SHOW STATUS */
+static volatile long long samples_taken;
+static volatile long long samples_dropped;
+static volatile int threads_profiled;
+
+/* static variables for SHOW VARIABLES */
+static my_bool profiler_enabled= 0;
+static uint profiler_frequency= 99;
+
+/* sampling state */
+static stack_sample *sample_ring= NULL;
+static volatile ulonglong sample_ring_pos= 0;
+static volatile int profiler_active= 0;
+static volatile int handlers_running= 0;
+static long sysconf_page_size= 4096;
+static struct sigaction saved_sigprof;          /* restored by deinit */
+
+/* aggregated stacks, protected by stacks_lock */
+static stack_entry *stacks= NULL;
+static uint stacks_used= 0;
+static uint stacks_session= 0;                  /* bumped by every profiler_start() */
+static pthread_mutex_t stacks_lock= PTHREAD_MUTEX_INITIALIZER;
+
+/* control thread state, protected by control_lock */
+static profiled_thread profiled_threads[MAX_PROFILED_THREADS];
+static uint profiled_threads_count= 0;
+static uint armed_frequency= 0;
+static pthread_t control_thread;
+static bool control_running= false;
+static bool control_stop= false;
+static pthread_mutex_t control_lock= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t control_cond= PTHREAD_COND_INITIALIZER;
+
+/* function prototypes */
+static void update_enabled(MYSQL_THD thd, struct st_mysql_sys_var *var, void *tgt, const void *save);
+static bool profiler_start();
+static void profiler_stop();
+
+/*
+   Plugin system variables for SHOW VARIABLES
+*/
+static MYSQL_SYSVAR_BOOL(enabled, profiler_enabled,
+                         PLUGIN_VAR_OPCMDARG,
+                         "Sample stacks of mysqld threads while ON",
+                         NULL, &update_enabled, 0);
+static MYSQL_SYSVAR_UINT(frequency, profiler_frequency,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Samples per CPU-second of each thread",
+                         NULL, NULL, 99, 1, 1000, 0);
+
+static struct st_mysql_sys_var* cpu_profiler_sysvars[] = {
+    MYSQL_SYSVAR(enabled),
+    MYSQL_SYSVAR(frequency),
+    NULL
+};
+
+/*
+  Reads a frame record through the kernel: a frame pointer that is not
+  one, in code built without them, gives EFAULT instead of SIGSEGV.
+  Pages already read are trusted for the rest of the walk.
+*/
+static bool read_frame(void **fp, void **record, size_t *safe_lo, size_t *safe_hi)
+{
+  size_t addr= (size_t) fp;
+
+  if (addr >= *safe_lo && addr + 2 * sizeof(void*) <= *safe_hi)
+  {
+    record[0]= fp[0];
+    record[1]= fp[1];
+    return true;
+  }
+
+  iovec local= { record, 2 * sizeof(void*) };
+  iovec remote= { fp, 2 * sizeof(void*) };
+  if (syscall(SYS_process_vm_readv, getpid(), &local, 1UL, &remote, 1UL, 0UL) !=
+      (long) (2 * sizeof(void*)))
+    return false;
+
+  size_t page= (size_t) sysconf_page_size;
+  size_t lo= addr & ~(page - 1);
+  if (lo > *safe_hi)                            /* not next to the pages read so far */
+    *safe_lo= lo;
+  *safe_hi= (addr + 2 * sizeof(void*) + page - 1) & ~(page - 1);
+  return true;
+}
+
+/*
+  Walks the frame pointer chain of the interrupted context: the program
+  counter first, then the return address of every frame.  Frames grow
+  towards higher addresses, a step backwards or too far ends the walk.
+*/
+static int unwind_context(ucontext_t *uc, void **frames, int max_depth)
+{
+  void *pc, **fp;
+  size_t safe_lo= 0, safe_hi= 0;
+  int depth= 0;
+
+#if defined(__x86_64__)
+  pc= (void*) uc->uc_mcontext.gregs[REG_RIP];
+  fp= (void**) uc->uc_mcontext.gregs[REG_RBP];
+#elif defined(__i386__)
+  pc= (void*) uc->uc_mcontext.gregs[REG_EIP];
+  fp= (void**) uc->uc_mcontext.gregs[REG_EBP];
+#elif defined(__aarch64__)
+  pc= (void*) uc->uc_mcontext.pc;
+  fp= (void**) uc->uc_mcontext.regs[29];
+#else
+  return 0;
+#endif
+
+  frames[depth++]= pc;
+  while (depth < max_depth && fp && !((size_t) fp & (sizeof(void*) - 1)))
+  {
+    void *record[2];                            /* saved frame pointer, return address */
+    if (!read_frame(fp, record, &safe_lo, &safe_hi) || !record[1])
+      break;
+    frames[depth++]= record[1];
+
+    void **next= (void**) record[0];
+    if (next <= fp || (size_t) next - (size_t) fp > MAX_FRAME_SIZE)
+      break;
+    fp= next;
+  }
+  return depth;
+}
+
+/*
+  SIGPROF handler.  Only async-signal-safe work here: claim a ring slot
+  with an atomic increment, walk the frame pointers into it, publish it.
+  A slot that has not been drained yet is not overwritten, the sample is
+  dropped instead.  handlers_running lets deinit wait for handlers still
+  writing to the ring before freeing it.
+*/
+static void sigprof_handler(int sig, siginfo_t *info, void *ucontext)
+{
+  __sync_fetch_and_add(&handlers_running, 1);
+  if (!profiler_active)
+  {
+    __sync_fetch_and_sub(&handlers_running, 1);
+    return;
+  }
+
+  int saved_errno= errno;
+  ulonglong pos= __sync_fetch_and_add(&sample_ring_pos, 1);
+  stack_sample *sample= &sample_ring[pos & (SAMPLE_RING_SIZE - 1)];
+
+  if (__sync_bool_compare_and_swap(&sample->state, SAMPLE_FREE, SAMPLE_WRITING))
+  {
+    sample->depth= unwind_context((ucontext_t*) ucontext, sample->frames, MAX_STACK_DEPTH);
+    __sync_synchronize();
+    sample->state= SAMPLE_READY;
+    __sync_fetch_and_add(&samples_taken, 1);
+  }
+  else
+    __sync_fetch_and_add(&samples_dropped, 1);
+  errno= saved_errno;
+  __sync_fetch_and_sub(&handlers_running, 1);
+}
+
+static uint hash_frames(void * const *frames, int depth)
+{
+  uint hash= 2166136261U;
+  for (int i= 0; i < depth; i++)
+    hash= (hash ^ (uint) (size_t) frames[i]) * 16777619U;
+  return hash;
+}
+
+/* move ready samples from the ring into the stacks table */
+static void drain_samples()
+{
+  pthread_mutex_lock(&stacks_lock);
+  for (uint i= 0; i < SAMPLE_RING_SIZE; i++)
+  {
+    stack_sample *sample= &sample_ring[i];
+    if (sample->state != SAMPLE_READY)
+      continue;
+    __sync_synchronize();
+
+    int depth= sample->depth;
+    void **frames= sample->frames;
+    uint hash= hash_frames(frames, depth);
+    uint slot= hash & (MAX_UNIQUE_STACKS - 1);
+
+    /* open addressing, linear probing; the table is never shrunk */
+    for (uint probe= 0; probe < MAX_UNIQUE_STACKS; probe++, slot= (slot + 1) & (MAX_UNIQUE_STACKS - 1))
+    {
+      stack_entry *entry= &stacks[slot];
+      if (entry->count == 0)
+      {
+        if (stacks_used >= MAX_UNIQUE_STACKS / 4 * 3)
+        {
+          __sync_fetch_and_add(&samples_dropped, 1);
+          break;
+        }
+        entry->hash= hash;
+        entry->depth= depth;
+        memcpy(entry->frames, frames, depth * sizeof(void*));
+        entry->count= 1;
+        stacks_used++;
+        break;
+      }
+      if (   entry->hash == hash && entry->depth == depth
+          && !memcmp(entry->frames, frames, depth * sizeof(void*)))
+      {
+        entry->count++;
+        break;
+      }
+    }
+    sample->state= SAMPLE_FREE;
+  }
+  pthread_mutex_unlock(&stacks_lock);
+}
+
+/* arm or re-arm the per-thread CPU timer */
+static bool arm_timer(profiled_thread *pt, uint frequency)
+{
+  itimerspec its;
+  its.it_interval.tv_sec= 0;
+  its.it_interval.tv_nsec= 1000000000L / frequency;
+  its.it_value= its.it_interval;
+  return timer_settime(pt->timer, 0, &its, NULL) != 0;
+}
+
+/*
+  Keep one timer per live thread: create timers for threads that appeared
+  since the last scan and delete the ones of threads that exited.
+*/
+static void rescan_threads(pid_t self)
+{
+  DIR *dir= opendir("/proc/self/task");
+  dirent *de;
+  uint frequency= profiler_frequency;
+
+  if (!dir)
+    return;
+
+  for (uint i= 0; i < profiled_threads_count; i++)
+    profiled_threads[i].seen= false;
+
+  while ((de= readdir(dir)))
+  {
+    pid_t tid= (pid_t) atoi(de->d_name);
+    uint i;
+    if (tid <= 0 || tid == self)
+      continue;
+
+    for (i= 0; i < profiled_threads_count && profiled_threads[i].tid != tid; i++)
+      ;
+    if (i < profiled_threads_count)
+    {
+      profiled_threads[i].seen= true;
+      if (frequency != armed_frequency)
+        arm_timer(&profiled_threads[i], frequency);
+      continue;
+    }
+    if (profiled_threads_count >= MAX_PROFILED_THREADS)
+      continue;
+
+    profiled_thread *pt= &profiled_threads[profiled_threads_count];
+    sigevent sev;
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify= SIGEV_THREAD_ID;
+    sev.sigev_signo= SIGPROF;
+    sev.sigev_notify_thread_id= tid;
+    if (timer_create(THREAD_CPU_CLOCK(tid), &sev, &pt->timer))
+      continue;                                 /* thread exited meanwhile */
+    if (arm_timer(pt, frequency))
+    {
+      timer_delete(pt->timer);
+      continue;
+    }
+    pt->tid= tid;
+    pt->seen= true;
+    profiled_threads_count++;
+  }
+  closedir(dir);
+  armed_frequency= frequency;
+
+  for (uint i= 0; i < profiled_threads_count; )
+  {
+    if (profiled_threads[i].seen)
+    {
+      i++;
+      continue;
+    }
+    timer_delete(profiled_threads[i].timer);
+    profiled_threads[i]= profiled_threads[--profiled_threads_count];
+  }
+  threads_profiled= profiled_threads_count;
+}
+
+static void *control_thread_main(void *arg __attribute__((unused)))
+{
+  pid_t self= (pid_t) syscall(SYS_gettid);
+  ulonglong since_rescan= RESCAN_INTERVAL_MS;
+
+  pthread_mutex_lock(&control_lock);
+  while (!control_stop)
+  {
+    if (since_rescan >= RESCAN_INTERVAL_MS)
+    {
+      rescan_threads(self);
+      since_rescan= 0;
+    }
+
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec+= DRAIN_INTERVAL_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec-= 1000000000L;
+    }
+    pthread_cond_timedwait(&control_cond, &control_lock, &deadline);
+    since_rescan+= DRAIN_INTERVAL_MS;
+
+    pthread_mutex_unlock(&control_lock);
+    drain_samples();
+    pthread_mutex_lock(&control_lock);
+  }
+
+  for (uint i= 0; i < profiled_threads_count; i++)
+    timer_delete(profiled_threads[i].timer);
+  profiled_threads_count= 0;
+  threads_profiled= 0;
+  pthread_mutex_unlock(&control_lock);
+  return NULL;
+}
+
+static bool profiler_start()
+{
+  if (control_running)
+    return false;
+
+  /* a new profiling session starts from empty stacks */
+  pthread_mutex_lock(&stacks_lock);
+  memset(stacks, 0, MAX_UNIQUE_STACKS * sizeof(stack_entry));
+  stacks_used= 0;
+  stacks_session++;
+  pthread_mutex_unlock(&stacks_lock);
+
+  control_stop= false;
+  armed_frequency= 0;
+  profiler_active= 1;
+  if (pthread_create(&control_thread, NULL, control_thread_main, NULL))
+  {
+    profiler_active= 0;
+    return true;
+  }
+  control_running= true;
+  return false;
+}
+
+static void profiler_stop()
+{
+  if (!control_running)
+    return;
+
+  pthread_mutex_lock(&control_lock);
+  control_stop= true;
+  pthread_cond_signal(&control_cond);
+  pthread_mutex_unlock(&control_lock);
+  pthread_join(control_thread, NULL);
+  control_running= false;
+
+  /* timers are gone, signals still in flight are ignored by the handler */
+  profiler_active= 0;
+  drain_samples();
+}
+
+/*
+   Check and Update functions
+*/
+static void update_enabled(MYSQL_THD thd, struct st_mysql_sys_var *var,
+                           void *tgt, const void *save)
+{
+  my_bool enable= *(my_bool *) save;
+
+  if (enable)
+    enable= !profiler_start();
+  else
+    profiler_stop();
+  *(my_bool *) tgt= enable;
+}
+
+/*
+  Symbol names are resolved once per address: dladdr() scans the symbol
+  table linearly, and the same frames repeat across many stacks.  The
+  cache is allocated with the plugin and kept for a profiling session,
+  readers of the table take turns on it.
+*/
+#define SYMBOL_CACHE_SIZE 16384                 /* power of two */
+
+struct symbol_cache_entry
+{
+  void *addr;
+  char *name;
+};
+
+static symbol_cache_entry *symbol_cache= NULL;
+static uint symbol_cache_session= 0;
+static pthread_mutex_t symbol_cache_lock= PTHREAD_MUTEX_INITIALIZER;
+
+static void symbol_cache_clear()
+{
+  for (uint i= 0; i < SYMBOL_CACHE_SIZE; i++)
+    free(symbol_cache[i].name);
+  memset(symbol_cache, 0, SYMBOL_CACHE_SIZE * sizeof(symbol_cache_entry));
+}
+
+/* the name is in the cache, or in buf when the cache is full */
+static const char *symbolize(symbol_cache_entry *cache, void *addr,
+                             char *buf, size_t size)
+{
+  uint slot= ((uint) ((size_t) addr >> 2) * 2654435761U) & (SYMBOL_CACHE_SIZE - 1);
+  Dl_info dl;
+  char *demangled= NULL;
+
+  for (uint probe= 0; probe < SYMBOL_CACHE_SIZE; probe++, slot= (slot + 1) & (SYMBOL_CACHE_SIZE - 1))
+  {
+    if (cache[slot].addr == addr)
+      return cache[slot].name;
+    if (cache[slot].addr == NULL)
+      break;
+  }
+
+  int found= dladdr(addr, &dl);
+
+  if (found && dl.dli_sname)
+  {
+    int status;
+    demangled= abi::__cxa_demangle(dl.dli_sname, NULL, NULL, &status);
+    snprintf(buf, size, "%s", demangled ? demangled : dl.dli_sname);
+    free(demangled);
+  }
+  else if (found && dl.dli_fname)
+  {
+    const char *base= strrchr(dl.dli_fname, '/');
+    snprintf(buf, size, "%s+0x%lx", base ? base + 1 : dl.dli_fname,
+             (ulong) ((char*) addr - (char*) dl.dli_fbase));
+  }
+  else
+    snprintf(buf, size, "0x%lx", (ulong) addr);
+
+  if (cache[slot].addr == NULL && (cache[slot].name= strdup(buf)))
+  {
+    cache[slot].addr= addr;
+    return cache[slot].name;
+  }
+  return buf;
+}
+
+/*define table fields*/
+
+ST_FIELD_INFO cpu_profile_fields[]=
+{
+  {"STACK", MAX_FOLDED_STACK_LENGTH, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"SAMPLES", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {0, 0, MYSQL_TYPE_NULL, 0, 0, 0, 0}
+};
+
+struct folded_stack
+{
+  char *text;
+  ulonglong count;
+};
+
+static int compare_folded(const void *a, const void *b)
+{
+  return strcmp(((const folded_stack*) a)->text, ((const folded_stack*) b)->text);
+}
+
+/* folded format: outermost frame first, frames separated by ';' */
+static char *fold_stack(symbol_cache_entry *cache, const stack_entry *entry)
+{
+  char buf[MAX_FOLDED_STACK_LENGTH];
+  char symbol[1024];
+  size_t len= 0;
+
+  for (int f= entry->depth - 1; f >= 0; f--)
+  {
+    const char *name= symbolize(cache, entry->frames[f], symbol, sizeof(symbol));
+    size_t name_len= strlen(name);
+    if (len + name_len + 1 >= sizeof(buf))
+      break;
+    if (len)
+      buf[len++]= ';';
+    memcpy(buf + len, name, name_len);
+    len+= name_len;
+  }
+  buf[len]= '\0';
+  return strdup(buf);
+}
+
+#if MYSQL_VERSION_ID > 50600
+static int fill_cpu_profile(THD *thd, TABLE_LIST *tables, Item *item)
+#else
+static int fill_cpu_profile(THD *thd, TABLE_LIST *tables, COND *cond)
+#endif
+{
+  CHARSET_INFO *cs= system_charset_info;
+  TABLE *table= tables->table;
+  int error= 0;
+  uint count= 0, session;
+
+  drain_samples();
+
+  /* copy the stacks out so that profiling is not blocked by symbolization */
+  pthread_mutex_lock(&stacks_lock);
+  stack_entry *snapshot= (stack_entry*) malloc((stacks_used + 1) * sizeof(stack_entry));
+  if (snapshot)
+    for (uint i= 0; i < MAX_UNIQUE_STACKS; i++)
+      if (stacks[i].count)
+        snapshot[count++]= stacks[i];
+  session= stacks_session;
+  pthread_mutex_unlock(&stacks_lock);
+
+  folded_stack *folded= (folded_stack*) calloc(count + 1, sizeof(folded_stack));
+  if (!snapshot || !folded)
+    error= 1;
+
+  /* libraries may have moved since the last session */
+  pthread_mutex_lock(&symbol_cache_lock);
+  if (symbol_cache_session != session)
+  {
+    symbol_cache_clear();
+    symbol_cache_session= session;
+  }
+  for (uint i= 0; i < count && !error; i++)
+  {
+    folded[i].text= fold_stack(symbol_cache, &snapshot[i]);
+    folded[i].count= snapshot[i].count;
+    if (!folded[i].text)
+      error= 1;
+  }
+  pthread_mutex_unlock(&symbol_cache_lock);
+
+  /*
+    Stacks that differ only in return addresses inside the same functions
+    fold to the same text; sort to merge them into one row.
+  */
+  if (!error)
+    qsort(folded, count, sizeof(folded_stack), compare_folded);
+
+  for (uint i= 0; i < count && !error; i++)
+  {
+    ulonglong samples= folded[i].count;
+    while (i + 1 < count && !strcmp(folded[i].text, folded[i + 1].text))
+      samples+= folded[++i].count;
+
+    table->field[0]->store(folded[i].text, strlen(folded[i].text), cs);
+    table->field[1]->store(samples, 1);
+    error= schema_table_store_record(thd, table);
+  }
+
+  if (folded)
+  {
+    for (uint i= 0; i < count; i++)
+      free(folded[i].text);
+    free(folded);
+  }
+  free(snapshot);
+  return error;
+}
+
+int cpu_profiler_init(void *p)
+{
+  ST_SCHEMA_TABLE *schema= (ST_SCHEMA_TABLE*) p;
+  struct sigaction sa;
+
+  schema->fields_info= cpu_profile_fields;
+  schema->fill_table= fill_cpu_profile;
+
+  sample_ring= (stack_sample*) calloc(SAMPLE_RING_SIZE, sizeof(stack_sample));
+  stacks= (stack_entry*) calloc(MAX_UNIQUE_STACKS, sizeof(stack_entry));
+  symbol_cache= (symbol_cache_entry*) calloc(SYMBOL_CACHE_SIZE, sizeof(symbol_cache_entry));
+  if (!sample_ring || !stacks || !symbol_cache)
+    return 1;
+
+  sysconf_page_size= sysconf(_SC_PAGESIZE);
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction= sigprof_handler;
+  sa.sa_flags= SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGPROF, &sa, &saved_sigprof))
+    return 1;
+
+  samples_taken= 0;
+  samples_dropped= 0;
+  threads_profiled= 0;
+
+  if (profiler_enabled && profiler_start())
+    profiler_enabled= 0;
+  return 0;
+}
+
+static int cpu_profiler_deinit(void *p)
+{
+  /* deletes the timers, so no new SIGPROF is raised */
+  profiler_stop();
+  /*
+    The handler is unloaded with the library, a late SIGPROF must not
+    reach it: give the signal back to whoever had it.  The default action
+    would end mysqld on a SIGPROF still pending from our timers, so that
+    one is replaced by ignoring the signal.
+  */
+  if (saved_sigprof.sa_handler == SIG_DFL && !(saved_sigprof.sa_flags & SA_SIGINFO))
+    saved_sigprof.sa_handler= SIG_IGN;
+  sigaction(SIGPROF, &saved_sigprof, NULL);
+  /* handlers that started before still see profiler_active or are done */
+  __sync_synchronize();
+  while (handlers_running)
+    sched_yield();
+  free(sample_ring);
+  free(stacks);
+  sample_ring= NULL;
+  stacks= NULL;
+  if (symbol_cache)
+  {
+    symbol_cache_clear();
+    free(symbol_cache);
+    symbol_cache= NULL;
+  }
+  return 0;
+}
+
+struct st_mysql_information_schema is_cpu_profiler=
+{
+  MYSQL_INFORMATION_SCHEMA_INTERFACE_VERSION  /* interface version    */
+};
+
+/*
+   Plugin status variables for SHOW STATUS
+*/
+static struct st_mysql_show_var cpu_profiler_status[]=
+{
+  { "Cpu_profile_samples",         (char *) &samples_taken,    SHOW_LONGLONG },
+  { "Cpu_profile_dropped_samples", (char *) &samples_dropped,  SHOW_LONGLONG },
+  { "Cpu_profile_threads",         (char *) &threads_profiled, SHOW_INT },
+  { 0, 0, SHOW_INT }
+};
+
+/*
+ Plugin library descriptor
+*/
+mysql_declare_plugin(mysql_is_cpu_profiler)
+{
+  MYSQL_INFORMATION_SCHEMA_PLUGIN,            /* type                            */
+  &is_cpu_profiler,                           /* descriptor                      */
+  "CPU_PROFILE",                              /* name                            */
+  "PaynetEasy",                               /* author                          */
+  "Sampled mysqld stacks in folded format",   /* description                     */
+  PLUGIN_LICENSE_GPL,
+  cpu_profiler_init,                          /* init function (when loaded)     */
+  cpu_profiler_deinit,                        /* deinit function (when unloaded) */
+  0x0010,                                     /* version                         */
+  cpu_profiler_status,                        /* status variables                */
+  cpu_profiler_sysvars,                       /* system variables                */
+  NULL,                                       /* config options                  */
+  0,                                          /* flags                           */
+}
+mysql_declare_plugin_end;
@@ -0,0 +1,627 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: OpenMetrics exporter served from inside mysqld.
+
+   A plugin thread answers scrapes on a Unix domain socket and/or a
+   127.0.0.1 port without entering the SQL layer.  The exposition is
+   built into a preallocated buffer and rebuilt at most once per
+   refresh interval, so concurrent or repeated scrapes are a plain write.
+   Clients are non-blocking and multiplexed with poll(), a slow or idle
+   one only holds its own slot until CLIENT_TIMEOUT_SEC.
+*/
+#define MYSQL_SERVER
+
+#include <my_pthread.h>
+#include <sql_priv.h>
+#include <mysql/plugin.h>
+#include <sql_class.h>
+#include <sql_cache.h>                          // query_cache
+#include <sql_plugin.h>                         // opt_plugin_dir
+
+#include "my_global.h"                          //
+#include "../sys_usage/proc_io.h"               // read_proc_io
+
+#include <dlfcn.h>                              // dlopen
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <syslog.h>                             // syslog
+#include <time.h>
+
+#if !defined(__attribute__) && (defined(__cplusplus) || !defined(__GNUC__)  || __GNUC__ == 2 && __GNUC_MINOR__ < 8)
+#define __attribute__(A)
+#endif
+
+#define METRICS_BUFFER_SIZE 65536
+#define REQUEST_BUFFER_SIZE 4096
+#define CLIENT_TIMEOUT_SEC 1
+#define MAX_CLIENTS 16
+
+/* static counters for SHOW STATUS */
+static volatile long long scrapes_served;
+static volatile long long metrics_rebuilds;
+
+/* static variables for SHOW VARIABLES */
+static char *exporter_socket= NULL;
+static uint exporter_port= 0;
+static uint exporter_refresh_interval= 1000;
+static char *exporter_plugins= NULL;
+
+/*
+   Plugin system variables for SHOW VARIABLES
+*/
+static MYSQL_SYSVAR_STR(socket, exporter_socket,
+                        PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY | PLUGIN_VAR_MEMALLOC,
+                        "Unix domain socket to serve metrics on, empty to disable",
+                        NULL, NULL, "");
+static MYSQL_SYSVAR_UINT(port, exporter_port,
+                         PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                         "127.0.0.1 TCP port to serve metrics on, 0 to disable",
+                         NULL, NULL, 0, 0, 65535, 0);
+static MYSQL_SYSVAR_UINT(refresh_interval, exporter_refresh_interval,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Milliseconds a built exposition is reused for",
+                         NULL, NULL, 1000, 0, 3600000, 0);
+static MYSQL_SYSVAR_STR(plugins, exporter_plugins,
+                        PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY | PLUGIN_VAR_MEMALLOC,
+                        "Comma separated plugin libraries whose status variables are exported",
+                        NULL, NULL, "audit_syslog.so");
+
+static struct st_mysql_sys_var* metrics_exporter_sysvars[] = {
+    MYSQL_SYSVAR(socket),
+    MYSQL_SYSVAR(port),
+    MYSQL_SYSVAR(refresh_interval),
+    MYSQL_SYSVAR(plugins),
+    NULL
+};
+
+/* exporter thread state */
+static int listen_fds[2]= { -1, -1 };
+static int wakeup_pipe[2]= { -1, -1 };
+static pthread_t exporter_thread;
+static bool exporter_running= false;
+static volatile bool exporter_stopping= false;  /* when the wakeup pipe fails */
+static bool socket_bound= false;
+
+/* a scrape in progress: reading its request, then writing the response */
+struct exporter_client
+{
+  int fd;
+  bool writing;
+  ulonglong deadline_ms;
+  size_t received;
+  char request[REQUEST_BUFFER_SIZE];
+  char header[256];
+  size_t header_len;
+  size_t sent;                                  /* of header, then body */
+};
+
+static exporter_client clients[MAX_CLIENTS];
+static uint clients_count= 0;
+
+/* the exposition, only touched by the exporter thread */
+static char metrics_buf[METRICS_BUFFER_SIZE];
+static size_t metrics_len= 0;
+static ulonglong metrics_built_ms= 0;
+static bool metrics_built= false;
+
+static ulonglong monotonic_ms()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ulonglong) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* append to metrics_buf, silently truncating at the end of the buffer */
+static void metrics_append(const char *format, ...)
+{
+  va_list args;
+  size_t left= sizeof(metrics_buf) - metrics_len;
+  if (left <= 1)
+    return;
+  va_start(args, format);
+  int len= vsnprintf(metrics_buf + metrics_len, left, format, args);
+  va_end(args);
+  if (len > 0)
+    metrics_len+= (size_t) len < left ? (size_t) len : left - 1;
+}
+
+static void metric_header(const char *name, const char *type, const char *help)
+{
+  metrics_append("# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+static void counter(const char *name, const char *help, ulonglong value)
+{
+  metric_header(name, "counter", help);
+  metrics_append("%s_total %llu\n", name, value);
+}
+
+static void gauge(const char *name, const char *help, ulonglong value)
+{
+  metric_header(name, "gauge", help);
+  metrics_append("%s %llu\n", name, value);
+}
+
+static void append_process_metrics()
+{
+  rusage r_usage;
+  rlimit r_limit;
+  proc_io p_io;
+
+  if (!getrusage(RUSAGE_SELF, &r_usage))
+  {
+    metric_header("mysql_process_cpu_user_seconds", "counter", "User CPU time used");
+    metrics_append("mysql_process_cpu_user_seconds_total %ld.%06ld\n",
+                   (long) r_usage.ru_utime.tv_sec, (long) r_usage.ru_utime.tv_usec);
+    metric_header("mysql_process_cpu_system_seconds", "counter", "System CPU time used");
+    metrics_append("mysql_process_cpu_system_seconds_total %ld.%06ld\n",
+                   (long) r_usage.ru_stime.tv_sec, (long) r_usage.ru_stime.tv_usec);
+    gauge("mysql_process_max_resident_bytes", "Maximum resident set size",
+          (ulonglong) r_usage.ru_maxrss * 1024);
+    counter("mysql_process_minor_page_faults", "Page reclaims (soft page faults)", r_usage.ru_minflt);
+    counter("mysql_process_major_page_faults", "Page faults (hard page faults)", r_usage.ru_majflt);
+    counter("mysql_process_block_input_operations", "Block input operations", r_usage.ru_inblock);
+    counter("mysql_process_block_output_operations", "Block output operations", r_usage.ru_oublock);
+    counter("mysql_process_voluntary_context_switches", "Voluntary context switches", r_usage.ru_nvcsw);
+    counter("mysql_process_involuntary_context_switches", "Involuntary context switches", r_usage.ru_nivcsw);
+  }
+  if (!getrlimit(RLIMIT_NOFILE, &r_limit))
+    gauge("mysql_process_max_open_files", "Maximum number of files", r_limit.rlim_cur);
+
+  if (!read_proc_io("/proc/self/io", &p_io))
+  {
+    counter("mysql_process_read_chars", "Bytes read through read syscalls", p_io.rchar);
+    counter("mysql_process_written_chars", "Bytes written through write syscalls", p_io.wchar);
+    counter("mysql_process_storage_read_bytes", "Bytes read from storage", p_io.read_bytes);
+    counter("mysql_process_storage_written_bytes", "Bytes written to storage", p_io.write_bytes);
+    counter("mysql_process_cancelled_write_bytes", "Written bytes truncated before reaching storage",
+            p_io.cancelled_write_bytes);
+  }
+}
+
+static void append_query_cache_metrics()
+{
+  /* the same unlocked reads SHOW STATUS does for the Qcache_* variables */
+  gauge("mysql_query_cache_size_bytes", "Query cache size", query_cache.query_cache_size);
+  gauge("mysql_query_cache_free_bytes", "Free query cache memory", query_cache.free_memory);
+  gauge("mysql_query_cache_queries", "Queries registered in the query cache", query_cache.queries_in_cache);
+  gauge("mysql_query_cache_blocks", "Blocks in the query cache", query_cache.total_blocks);
+  gauge("mysql_query_cache_free_blocks", "Free blocks in the query cache", query_cache.free_memory_blocks);
+  counter("mysql_query_cache_hits", "Query cache hits", query_cache.hits);
+  counter("mysql_query_cache_inserts", "Queries added to the query cache", query_cache.inserts);
+  counter("mysql_query_cache_not_cached", "Non-cacheable queries", query_cache.refused);
+  counter("mysql_query_cache_lowmem_prunes", "Queries removed due to low memory", query_cache.lowmem_prunes);
+}
+
+static void append_show_var(const char *library, const st_mysql_show_var *var)
+{
+  ulonglong value;
+
+  switch (var->type)
+  {
+  case SHOW_BOOL:
+    value= *(bool *) var->value;
+    break;
+  case SHOW_INT:
+    value= *(uint *) var->value;
+    break;
+  case SHOW_LONG:
+    value= *(ulong *) var->value;
+    break;
+  case SHOW_LONGLONG:
+    value= *(ulonglong *) var->value;
+    break;
+  default:                                      /* SHOW_FUNC, SHOW_ARRAY, strings */
+    return;
+  }
+  metrics_append("mysql_plugin_status{library=\"%s\",variable=\"%s\"} %llu\n",
+                 library, var->name, value);
+}
+
+/*
+  Export the status variables of the configured plugin libraries.  Every
+  dynamic plugin library publishes its descriptors as
+  _mysql_plugin_declarations_; RTLD_NOLOAD only finds a library the
+  server has already loaded and keeps it mapped while it is read.
+*/
+static void append_plugin_metrics()
+{
+  char libraries[FN_REFLEN];
+  char *save_ptr;
+
+  if (!exporter_plugins || !*exporter_plugins)
+    return;
+
+  metric_header("mysql_plugin_status", "unknown", "Plugin status variables as in SHOW STATUS");
+
+  strncpy(libraries, exporter_plugins, sizeof(libraries) - 1);
+  libraries[sizeof(libraries) - 1]= '\0';
+  for (char *library= strtok_r(libraries, ", ", &save_ptr); library;
+       library= strtok_r(NULL, ", ", &save_ptr))
+  {
+    char path[FN_REFLEN * 2];
+    snprintf(path, sizeof(path), "%s/%s", opt_plugin_dir, library);
+    void *handle= dlopen(path, RTLD_NOW | RTLD_NOLOAD);
+    if (!handle)
+      continue;
+
+    st_mysql_plugin *plugin= (st_mysql_plugin *) dlsym(handle, "_mysql_plugin_declarations_");
+    for (; plugin && plugin->info; plugin++)
+      for (st_mysql_show_var *var= plugin->status_vars; var && var->name; var++)
+        append_show_var(library, var);
+    dlclose(handle);
+  }
+}
+
+static void build_metrics()
+{
+  metrics_len= 0;
+  append_process_metrics();
+  append_query_cache_metrics();
+  append_plugin_metrics();
+  metrics_append("# EOF\n");
+  metrics_built_ms= monotonic_ms();
+  metrics_built= true;
+  metrics_rebuilds++;
+}
+
+/* false when the request head is complete or the client gave up */
+static bool read_request(exporter_client *client)
+{
+  for (;;)
+  {
+    size_t left= sizeof(client->request) - 1 - client->received;
+    if (!left)
+      return false;
+    ssize_t len= recv(client->fd, client->request + client->received, left, 0);
+    if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return true;
+    if (len <= 0)
+      return false;
+    client->received+= len;
+    client->request[client->received]= '\0';
+    if (strstr(client->request, "\r\n\r\n") || strstr(client->request, "\n\n"))
+      return false;
+  }
+}
+
+/* true when the response is sent or the client is gone */
+static bool write_response(exporter_client *client)
+{
+  size_t total= client->header_len + metrics_len;
+
+  while (client->sent < total)
+  {
+    const char *buf;
+    size_t len;
+    if (client->sent < client->header_len)
+    {
+      buf= client->header + client->sent;
+      len= client->header_len - client->sent;
+    }
+    else
+    {
+      buf= metrics_buf + client->sent - client->header_len;
+      len= total - client->sent;
+    }
+    ssize_t written= send(client->fd, buf, len, MSG_NOSIGNAL);
+    if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return false;
+    if (written <= 0)
+      return true;
+    client->sent+= written;
+  }
+  scrapes_served++;
+  return true;
+}
+
+static bool clients_writing()
+{
+  for (uint i= 0; i < clients_count; i++)
+    if (clients[i].writing)
+      return true;
+  return false;
+}
+
+/*
+  Prometheus speaks HTTP, so the request head is read and ignored; any
+  request gets the current exposition.  The buffer is not rebuilt while
+  another response is still being sent from it.
+*/
+static void start_response(exporter_client *client)
+{
+  if ((!metrics_built || monotonic_ms() - metrics_built_ms >= exporter_refresh_interval) &&
+      !clients_writing())
+    build_metrics();
+
+  client->header_len= snprintf(client->header, sizeof(client->header),
+                               "HTTP/1.0 200 OK\r\n"
+                               "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                               "Content-Length: %lu\r\n"
+                               "Connection: close\r\n\r\n", (ulong) metrics_len);
+  client->sent= 0;
+  client->writing= true;
+  client->deadline_ms= monotonic_ms() + CLIENT_TIMEOUT_SEC * 1000;
+}
+
+static void accept_client(int listen_fd)
+{
+  int fd= accept(listen_fd, NULL, NULL);
+  if (fd < 0)
+    return;
+  if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK))
+  {
+    close(fd);
+    return;
+  }
+  exporter_client *client= &clients[clients_count++];
+  client->fd= fd;
+  client->writing= false;
+  client->received= 0;
+  client->request[0]= '\0';
+  client->deadline_ms= monotonic_ms() + CLIENT_TIMEOUT_SEC * 1000;
+}
+
+static void close_client(uint i)
+{
+  close(clients[i].fd);
+  clients[i]= clients[--clients_count];
+}
+
+static void *exporter_thread_main(void *arg __attribute__((unused)))
+{
+  pollfd fds[3 + MAX_CLIENTS];
+
+  for (;;)
+  {
+    nfds_t nfds= 0, first_client;
+    ulonglong now= monotonic_ms();
+    int timeout= -1;
+
+    fds[nfds].fd= wakeup_pipe[0];
+    fds[nfds++].events= POLLIN;
+    /* a full table leaves new clients in the listen backlog */
+    for (uint i= 0; i < 2; i++)
+    {
+      fds[nfds].fd= clients_count < MAX_CLIENTS ? listen_fds[i] : -1;
+      fds[nfds++].events= POLLIN;
+    }
+    first_client= nfds;
+    for (uint i= 0; i < clients_count; i++)
+    {
+      fds[nfds].fd= clients[i].fd;
+      fds[nfds++].events= clients[i].writing ? POLLOUT : POLLIN;
+      int left= clients[i].deadline_ms > now ? (int) (clients[i].deadline_ms - now) : 0;
+      if (timeout < 0 || left < timeout)
+        timeout= left;
+    }
+
+    if (poll(fds, nfds, timeout) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (fds[0].revents || exporter_stopping)
+      break;
+
+    /* backwards, close_client() moves the last client into the hole */
+    now= monotonic_ms();
+    for (uint i= clients_count; i-- > 0; )
+    {
+      exporter_client *client= &clients[i];
+      bool ready= fds[first_client + i].revents != 0;
+      bool done= false;
+
+      if (ready && !client->writing && !read_request(client))
+        start_response(client);
+      if (client->writing && (ready || client->sent == 0))
+        done= write_response(client);
+      if (done || (!ready && now >= client->deadline_ms))
+        close_client(i);
+    }
+
+    for (uint i= 1; i < 3; i++)
+      if (fds[i].fd >= 0 && (fds[i].revents & POLLIN) && clients_count < MAX_CLIENTS)
+        accept_client(fds[i].fd);
+  }
+
+  while (clients_count)
+    close_client(clients_count - 1);
+  return NULL;
+}
+
+static int open_unix_listener(const char *path)
+{
+  sockaddr_un addr;
+  int fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path))
+    return -1;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family= AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  if ((fd= socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    return -1;
+
+  /*
+    Only a stale socket of a previous run is removed: never a file that
+    is not a socket, nor one another server still listens on.
+  */
+  struct stat st;
+  if (!lstat(path, &st))
+  {
+    int probe= -1, error;
+    if (!S_ISSOCK(st.st_mode))
+      error= EEXIST;
+    else if ((probe= socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+      error= errno;
+    else if (!connect(probe, (sockaddr *) &addr, sizeof(addr)))
+      error= EADDRINUSE;
+    else
+      error= errno == ECONNREFUSED || errno == ENOENT ? 0 : errno;
+    if (probe >= 0)
+      close(probe);
+    if (error)
+    {
+      close(fd);
+      errno= error;
+      return -1;
+    }
+    unlink(path);
+  }
+
+  if (bind(fd, (sockaddr *) &addr, sizeof(addr)) || listen(fd, 16))
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int open_tcp_listener(uint port)
+{
+  sockaddr_in addr;
+  int fd, on= 1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family= AF_INET;
+  addr.sin_port= htons((unsigned short) port);
+  addr.sin_addr.s_addr= htonl(INADDR_LOOPBACK);
+
+  if ((fd= socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    return -1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  if (bind(fd, (sockaddr *) &addr, sizeof(addr)) || listen(fd, 16))
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void close_listeners()
+{
+  for (uint i= 0; i < 2; i++)
+  {
+    if (listen_fds[i] >= 0)
+      close(listen_fds[i]);
+    listen_fds[i]= -1;
+  }
+  struct stat st;
+  if (socket_bound && !lstat(exporter_socket, &st) && S_ISSOCK(st.st_mode))
+    unlink(exporter_socket);
+  socket_bound= false;
+  for (uint i= 0; i < 2; i++)
+  {
+    if (wakeup_pipe[i] >= 0)
+      close(wakeup_pipe[i]);
+    wakeup_pipe[i]= -1;
+  }
+}
+
+/*
+   Initialize the plugin at server start or plugin installation.
+*/
+static int metrics_exporter_init(void *arg __attribute__((unused)))
+{
+  scrapes_served= 0;
+  metrics_rebuilds= 0;
+  metrics_built= false;
+
+  if (exporter_socket && *exporter_socket)
+  {
+    listen_fds[0]= open_unix_listener(exporter_socket);
+    socket_bound= listen_fds[0] >= 0;
+    if (!socket_bound)
+      syslog(LOG_ERR, "[METRICS EXPORTER] cannot listen on %s: %s\n", exporter_socket, strerror(errno));
+  }
+  if (exporter_port &&
+      (listen_fds[1]= open_tcp_listener(exporter_port)) < 0)
+    syslog(LOG_ERR, "[METRICS EXPORTER] cannot listen on 127.0.0.1:%u: %s\n", exporter_port, strerror(errno));
+
+  /* nothing configured: stay loaded but idle */
+  if (listen_fds[0] < 0 && listen_fds[1] < 0)
+    return 0;
+
+  if (pipe(wakeup_pipe) ||
+      pthread_create(&exporter_thread, NULL, exporter_thread_main, NULL))
+  {
+    close_listeners();
+    return 1;
+  }
+  exporter_running= true;
+  return 0;
+}
+
+/*
+   Terminate the plugin at server shutdown or plugin deinstallation.
+*/
+static int metrics_exporter_deinit(void *arg __attribute__((unused)))
+{
+  if (exporter_running)
+  {
+    char stop= 0;
+    ssize_t written;
+    while ((written= write(wakeup_pipe[1], &stop, 1)) < 0 && errno == EINTR)
+      ;
+    if (written != 1)
+    {
+      /* no pipe to wake the thread: make poll() return on the listeners */
+      exporter_stopping= true;
+      for (uint i= 0; i < 2; i++)
+        if (listen_fds[i] >= 0)
+          shutdown(listen_fds[i], SHUT_RDWR);
+    }
+    /* the thread polls the listeners, they are closed only after it ends */
+    pthread_join(exporter_thread, NULL);
+    exporter_running= false;
+  }
+  exporter_stopping= false;
+  close_listeners();
+  return 0;
+}
+
+static struct st_mysql_daemon metrics_exporter_descriptor=
+{
+  MYSQL_DAEMON_INTERFACE_VERSION
+};
+
+/*
+   Plugin status variables for SHOW STATUS
+*/
+static struct st_mysql_show_var metrics_exporter_status[]=
+{
+  { "Metrics_exporter_scrapes",  (char *) &scrapes_served,   SHOW_LONGLONG },
+  { "Metrics_exporter_rebuilds", (char *) &metrics_rebuilds, SHOW_LONGLONG },
+  { 0, 0, SHOW_INT }
+};
+
+/*
+  Plugin library descriptor
+*/
+mysql_declare_plugin(metrics_exporter)
+{
+  MYSQL_DAEMON_PLUGIN,          /* type                            */
+  &metrics_exporter_descriptor, /* descriptor                      */
+  "metrics_exporter",           /* name                            */
+  "PaynetEasy",                 /* author                          */
+  "OpenMetrics exporter",       /* description                     */
+  PLUGIN_LICENSE_GPL,
+  metrics_exporter_init,        /* init function (when loaded)     */
+  metrics_exporter_deinit,      /* deinit function (when unloaded) */
+  0x0001,                       /* version                         */
+  metrics_exporter_status,      /* status variables                */
+  metrics_exporter_sysvars,     /* system variables                */
+  NULL,
+  0,
+}
+mysql_declare_plugin_end;
@@ -10,11 +10,24 @@
 #include <security/pam_appl.h>
 #include <stdio.h>
 #include <syslog.h>                             // syslog
+#include "pam_auth.h"
 
-struct param {
-  unsigned char buf[10240], *ptr;
-  MYSQL_PLUGIN_VIO *vio;
-};
+/* static variables for SHOW VARIABLES */
+char *auth_cache_services = NULL;
+unsigned int auth_cache_ttl = 60;
+unsigned int auth_cache_size = 1024;
+unsigned int auth_cache_hash_rounds = 1000;
+unsigned int pam_auth_pool_size = 0;
+unsigned int pam_auth_queue_size = 64;
+unsigned int pam_auth_timeout = 10000;
+unsigned int breaker_threshold = 50;
+unsigned int breaker_min_calls = 10;
+unsigned int breaker_slow_time = 3000;
+unsigned int breaker_cooldown = 30;
+unsigned int throttle_host_threshold = 0;
+unsigned int throttle_user_threshold = 0;
+unsigned int throttle_window = 60;
+unsigned int throttle_delay = 0;
 
 static int conv(int n, const struct pam_message **msg,
                 struct pam_response **resp, void *data)
@@ -40,6 +53,7 @@ static int conv(int n, const struct pam_message **msg,
         msg[i]->msg_style == PAM_PROMPT_ECHO_ON) {
       int pkt_len;
       unsigned char *pkt;
+      int packet_len;
 
       /* allocate the response array.
          freeing it is the responsibility of the caller */
@@ -55,12 +69,46 @@ static int conv(int n, const struct pam_message **msg,
          4 means "password-like input, echo disabled"
          C'est la vie. */
       param->buf[0] = msg[i]->msg_style == PAM_PROMPT_ECHO_ON ? 2 : 4;
-      if (param->vio->write_packet(param->vio, param->buf, param->ptr - param->buf - 1))
-        return PAM_CONV_ERR;
+      packet_len = param->ptr - param->buf - 1;
+
+      if (param->replay && param->prompts == 0 && packet_len == param->prompt_len &&
+          !memcmp(param->buf, param->prompt, packet_len)) {
+        /* the auth cache already asked this question, answer with its reply */
+        pkt = (unsigned char *)param->reply;
+        pkt_len = param->reply_len;
+      } else {
+        long long conv_start = monotonic_usec(), conv_usec;
+
+        /* a pool worker asks the connection thread to talk to the client */
+        if (param->job)
+          pkt_len = pam_job_exchange(param->job, param->buf, packet_len, &pkt);
+        else if (param->vio->write_packet(param->vio, param->buf, packet_len))
+          pkt_len = -1;
+        else
+          pkt_len = param->vio->read_packet(param->vio, &pkt);
+
+        conv_usec = monotonic_usec() - conv_start;
+        param->conv_usec += conv_usec;
+        pam_stats_record(param->service, STAGE_CONVERSATION,
+                         pkt_len < 0 ? PAM_CONV_ERR : PAM_SUCCESS, conv_usec);
+        if (pkt_len < 0)
+          return PAM_CONV_ERR;
+
+        /* keep the first question and answer for the auth cache */
+        if (param->cache && param->prompts == 0) {
+          if (packet_len <= AUTH_CACHE_PROMPT_SIZE && pkt_len < AUTH_CACHE_SECRET_SIZE) {
+            memcpy(param->prompt, param->buf, packet_len);
+            param->prompt_len = packet_len;
+            memcpy(param->reply, pkt, pkt_len);
+            param->reply[pkt_len] = 0;
+            param->reply_len = pkt_len;
+          } else
+            param->prompt_len = 0;
+        }
+      }
+      param->replay = 0;
+      param->prompts++;
 
-      pkt_len = param->vio->read_packet(param->vio, &pkt);
-      if (pkt_len < 0)
-        return PAM_CONV_ERR;
       /* allocate and copy the reply to the response array */
       (*resp)[i].resp= strndup((char*)pkt, pkt_len);
       param->ptr = param->buf + 1;
@@ -80,31 +128,365 @@ static int conv(int n, const struct pam_message **msg,
     }                                   \
   } while(0)
 
-static int pam_auth(MYSQL_PLUGIN_VIO *vio, MYSQL_SERVER_AUTH_INFO *info)
+/* DO_PAM that also records the time of the call, minus client round-trips */
+#define DO_PAM_TIMED(STAGE, X)          \
+  do {                                  \
+    long long stage_start = monotonic_usec() - param->conv_usec; \
+    status = (X);                       \
+    pam_stats_record(param->service, STAGE, status, \
+                     monotonic_usec() - param->conv_usec - stage_start); \
+    if (status != PAM_SUCCESS)          \
+    {                                   \
+      syslog(LOG_ERR, "[AUTH FAILED] Reason: %s", pam_strerror(pamh, status)); \
+      goto ret;                         \
+    }                                   \
+  } while(0)
+
+int pam_session(struct param *param, const char *service, const char *user)
 {
   pam_handle_t *pamh = NULL;
   int status;
   const char *new_username;
-  struct param param;
-  struct pam_conv c = { &conv, &param };
+  struct pam_conv c = { &conv, param };
 
-  const char *service = info->auth_string ? info->auth_string : "mysql";
-
-  param.ptr = param.buf + 1;
-  param.vio = vio;
-
-  DO_PAM(pam_start(service, info->user_name, &c, &pamh));
-  DO_PAM(pam_authenticate (pamh, 0));
-  DO_PAM(pam_acct_mgmt(pamh, 0));
+  DO_PAM_TIMED(STAGE_START, pam_start(service, user, &c, &pamh));
+  DO_PAM_TIMED(STAGE_AUTHENTICATE, pam_authenticate (pamh, 0));
+  DO_PAM_TIMED(STAGE_ACCT_MGMT, pam_acct_mgmt(pamh, 0));
   DO_PAM(pam_get_item(pamh, PAM_USER, (const void**)&new_username));
   if (new_username)
-    strncpy(info->authenticated_as, new_username, sizeof(info->authenticated_as));
+    strncpy(param->authenticated_as, new_username, sizeof(param->authenticated_as) - 1);
 
 ret:
   pam_end(pamh, status);
-  return status == PAM_SUCCESS ? CR_OK : CR_ERROR;
+  return status;
 }
 
+/* account checks do not talk to the client: any question fails them */
+static int silent_conv(int n, const struct pam_message **msg,
+                       struct pam_response **resp, void *data)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    if (msg[i]->msg_style == PAM_PROMPT_ECHO_OFF ||
+        msg[i]->msg_style == PAM_PROMPT_ECHO_ON)
+      return PAM_CONV_ERR;
+  return PAM_SUCCESS;
+}
+
+/* pam_acct_mgmt alone, for a login whose password the auth cache verified */
+int pam_account_check(struct param *param, const char *service, const char *user)
+{
+  pam_handle_t *pamh = NULL;
+  int status;
+  struct pam_conv c = { &silent_conv, NULL };
+
+  DO_PAM_TIMED(STAGE_START, pam_start(service, user, &c, &pamh));
+  DO_PAM_TIMED(STAGE_ACCT_MGMT, pam_acct_mgmt(pamh, 0));
+
+ret:
+  pam_end(pamh, status);
+  return status;
+}
+
+/* what a finished PAM transaction tells about the health of the backend */
+static enum breaker_outcome breaker_outcome(int status)
+{
+  switch (status) {
+  case PAM_SUCCESS:
+  case PAM_AUTH_ERR:
+  case PAM_USER_UNKNOWN:
+  case PAM_PERM_DENIED:
+  case PAM_ACCT_EXPIRED:
+  case PAM_NEW_AUTHTOK_REQD:
+  case PAM_AUTHTOK_EXPIRED:
+  case PAM_CRED_INSUFFICIENT:
+  case PAM_MAXTRIES:
+    return BREAKER_SUCCESS;
+  case PAM_CONV_ERR:
+    return BREAKER_NEUTRAL;
+  default:
+    return BREAKER_FAILURE;
+  }
+}
+
+/* failures that count against the client for throttling */
+static int client_failure(int error)
+{
+  switch (error) {
+  case PAM_AUTH_ERR:
+  case PAM_USER_UNKNOWN:
+  case PAM_PERM_DENIED:
+  case PAM_MAXTRIES:
+  case PAM_CRED_INSUFFICIENT:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static int pam_auth(MYSQL_PLUGIN_VIO *vio, MYSQL_SERVER_AUTH_INFO *info)
+{
+  struct param local, *param = &local;
+  struct pam_job *job = NULL;
+  struct pam_service *svc;
+  enum pam_job_result result = PAM_JOB_DONE;
+  long long login_start = monotonic_usec();
+  long long start;
+  int status;
+  int error = PAM_SYSTEM_ERR;
+  int rc = CR_ERROR;
+
+  const char *service = info->auth_string ? info->auth_string : "mysql";
+  const char *host = info->host_or_ip ? info->host_or_ip : "";
+
+  svc = pam_service_get(service);
+
+  /*
+    Rejected attempts are not counted: they never reach PAM, and counting
+    them would keep a busy host locked long after its last real failure.
+  */
+  if (throttle_enabled() &&
+      throttle_check(info->user_name, host) == THROTTLE_REJECT) {
+    pam_stats_record(svc, STAGE_LOGIN, ERROR_THROTTLED, monotonic_usec() - login_start);
+    return CR_ERROR;
+  }
+
+  if (pam_auth_pool_size) {
+    job = pam_job_new(service, info->user_name);
+    if (!job)
+      return CR_ERROR;
+    param = pam_job_param(job);
+  }
+
+  param->ptr = param->buf + 1;
+  param->vio = vio;
+  param->job = job;
+  param->service = svc;
+  param->conv_usec = 0;
+  param->authenticated_as[0] = 0;
+  param->cache = auth_cache_enabled(service);
+  param->prompts = 0;
+  param->prompt_len = 0;
+  param->reply_len = 0;
+  param->replay = 0;
+  param->account_only = 0;
+
+  if (param->cache) {
+    switch (auth_cache_verify(vio, info, service, param)) {
+    case AUTH_CACHE_HIT:
+      /*
+        The password is known, the account may have been locked since:
+        pam_acct_mgmt still runs, behind the breaker and the timeout.
+      */
+      param->account_only = 1;
+      break;
+    case AUTH_CACHE_ERROR:
+      error = ERROR_CLIENT;
+      goto end;
+    default:
+      break;
+    }
+  }
+
+  if (!breaker_allow(param->service)) {
+    syslog(LOG_ERR, "[AUTH FAILED] Reason: PAM service %s is unavailable", service);
+    error = ERROR_BREAKER_OPEN;
+    goto end;
+  }
+
+  start = monotonic_usec();
+  if (job) {
+    result = pam_job_run(job, vio, pam_auth_timeout);
+    status = pam_job_status(job);
+  } else if (param->account_only)
+    status = pam_account_check(param, service, info->user_name);
+  else
+    status = pam_session(param, service, info->user_name);
+
+  switch (result) {
+  case PAM_JOB_BUSY:
+    syslog(LOG_ERR, "[AUTH FAILED] Reason: PAM worker queue is full");
+    breaker_record(param->service, BREAKER_NEUTRAL, 0);
+    error = ERROR_QUEUE_FULL;
+    goto end;
+  case PAM_JOB_TIMEOUT:
+    /* the worker still owns param, do not touch it */
+    syslog(LOG_ERR, "[AUTH FAILED] Reason: PAM service %s timed out", service);
+    breaker_record(param->service, BREAKER_FAILURE, monotonic_usec() - start);
+    error = ERROR_TIMEOUT;
+    goto end;
+  case PAM_JOB_DONE:
+    break;
+  }
+
+  breaker_record(param->service, breaker_outcome(status),
+                 monotonic_usec() - start - param->conv_usec);
+  error = status;
+
+  if (status == PAM_SUCCESS) {
+    if (param->authenticated_as[0])
+      strncpy(info->authenticated_as, param->authenticated_as,
+              sizeof(info->authenticated_as));
+    rc = CR_OK;
+  }
+
+  if (param->cache) {
+    if (status == PAM_SUCCESS && !param->account_only)
+      auth_cache_store(info, service, param);
+    else if (status != PAM_SUCCESS)
+      auth_cache_invalidate(info->user_name, service);
+  }
+
+end:
+  /* param may belong to an abandoned job, use svc */
+  pam_stats_record(svc, STAGE_LOGIN, error,
+                   monotonic_usec() - login_start);
+  if (throttle_enabled() && client_failure(error))
+    throttle_record_failure(info->user_name, host);
+  if (job)
+    pam_job_release(job);
+  else
+    wipe_memory(local.reply, sizeof(local.reply));
+  return rc;
+}
+
+static int pam_auth_init(void *p)
+{
+  pam_services_init();
+  throttle_init();
+  if (auth_cache_init())
+    return 1;
+  if (pam_pool_init()) {
+    auth_cache_deinit();
+    return 1;
+  }
+  return 0;
+}
+
+static int pam_auth_deinit(void *p)
+{
+  pam_pool_deinit();
+  auth_cache_deinit();
+  return 0;
+}
+
+/*
+   Plugin system variables for SHOW VARIABLES
+*/
+static MYSQL_SYSVAR_STR(cache_services, auth_cache_services,
+                        PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY | PLUGIN_VAR_MEMALLOC,
+                        "Comma separated PAM services whose successful logins are cached, "
+                        "empty to disable the cache",
+                        NULL, NULL, "");
+static MYSQL_SYSVAR_UINT(cache_ttl, auth_cache_ttl,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Seconds a cached login stays valid, 0 disables the cache. "
+                         "Cached logins skip pam_authenticate but still run pam_acct_mgmt",
+                         NULL, NULL, 60, 0, 86400, 0);
+static MYSQL_SYSVAR_UINT(cache_size, auth_cache_size,
+                         PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                         "Maximum number of cached logins",
+                         NULL, NULL, 1024, 16, 1048576, 0);
+static MYSQL_SYSVAR_UINT(cache_hash_rounds, auth_cache_hash_rounds,
+                         PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                         "SHA-512 crypt rounds used to hash cached secrets",
+                         NULL, NULL, 1000, 1000, 999999999, 0);
+static MYSQL_SYSVAR_UINT(pool_size, pam_auth_pool_size,
+                         PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                         "Number of threads running PAM transactions, "
+                         "0 runs them on the connection thread without a timeout",
+                         NULL, NULL, 0, 0, 1024, 0);
+static MYSQL_SYSVAR_UINT(queue_size, pam_auth_queue_size,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Maximum number of logins waiting for a PAM thread",
+                         NULL, NULL, 64, 1, 65536, 0);
+static MYSQL_SYSVAR_UINT(timeout, pam_auth_timeout,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Milliseconds a PAM login may take before it fails, 0 waits forever",
+                         NULL, NULL, 10000, 0, 3600000, 0);
+static MYSQL_SYSVAR_UINT(breaker_threshold, breaker_threshold,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Percentage of failed or slow PAM calls that opens the "
+                         "circuit breaker of a service, 0 disables the breaker",
+                         NULL, NULL, 50, 0, 100, 0);
+static MYSQL_SYSVAR_UINT(breaker_min_calls, breaker_min_calls,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Minimum number of PAM calls in a 10 second window "
+                         "before the circuit breaker may open",
+                         NULL, NULL, 10, 1, 1000000, 0);
+static MYSQL_SYSVAR_UINT(breaker_slow_time, breaker_slow_time,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Milliseconds after which a PAM call counts as failed "
+                         "for the circuit breaker, 0 to ignore latency",
+                         NULL, NULL, 3000, 0, 3600000, 0);
+static MYSQL_SYSVAR_UINT(breaker_cooldown, breaker_cooldown,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Seconds an open circuit breaker rejects logins before a probe",
+                         NULL, NULL, 30, 1, 86400, 0);
+
+static MYSQL_SYSVAR_UINT(throttle_host_threshold, throttle_host_threshold,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Failed logins from one host within the throttle window "
+                         "after which its logins are throttled, 0 to disable",
+                         NULL, NULL, 0, 0, 1000000, 0);
+static MYSQL_SYSVAR_UINT(throttle_user_threshold, throttle_user_threshold,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Failed logins of one user@host within the throttle window "
+                         "after which its logins are throttled, 0 to disable",
+                         NULL, NULL, 0, 0, 1000000, 0);
+static MYSQL_SYSVAR_UINT(throttle_window, throttle_window,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Seconds failed logins are remembered for throttling",
+                         NULL, NULL, 60, 1, 86400, 0);
+static MYSQL_SYSVAR_UINT(throttle_delay, throttle_delay,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Milliseconds a throttled login is delayed before PAM runs, "
+                         "0 rejects it at once. Throttled logins beyond 8 waiting "
+                         "at a time are rejected",
+                         NULL, NULL, 0, 0, 1000, 0);
+
+static struct st_mysql_sys_var *pam_auth_sysvars[] = {
+  MYSQL_SYSVAR(cache_services),
+  MYSQL_SYSVAR(cache_ttl),
+  MYSQL_SYSVAR(cache_size),
+  MYSQL_SYSVAR(cache_hash_rounds),
+  MYSQL_SYSVAR(pool_size),
+  MYSQL_SYSVAR(queue_size),
+  MYSQL_SYSVAR(timeout),
+  MYSQL_SYSVAR(breaker_threshold),
+  MYSQL_SYSVAR(breaker_min_calls),
+  MYSQL_SYSVAR(breaker_slow_time),
+  MYSQL_SYSVAR(breaker_cooldown),
+  MYSQL_SYSVAR(throttle_host_threshold),
+  MYSQL_SYSVAR(throttle_user_threshold),
+  MYSQL_SYSVAR(throttle_window),
+  MYSQL_SYSVAR(throttle_delay),
+  NULL
+};
+
+/*
+   Plugin status variables for SHOW STATUS
+*/
+static struct st_mysql_show_var pam_auth_status[] = {
+  { "Pam_auth_cache_hits",            (char *) &auth_cache_hits,                      SHOW_LONGLONG },
+  { "Pam_auth_cache_misses",          (char *) &auth_cache_misses,                    SHOW_LONGLONG },
+  { "Pam_auth_timeouts",              (char *) &pam_pool_timeouts,                    SHOW_LONGLONG },
+  { "Pam_auth_queue_rejects",         (char *) &pam_pool_rejects,                     SHOW_LONGLONG },
+  { "Pam_auth_breaker_rejects",       (char *) &breaker_rejects,                      SHOW_LONGLONG },
+  { "Pam_auth_breaker_trips",         (char *) &breaker_trips,                        SHOW_LONGLONG },
+  { "Pam_auth_throttle_rejects",      (char *) &throttle_rejects,                     SHOW_LONGLONG },
+  { "Pam_auth_throttle_delays",       (char *) &throttle_delays,                      SHOW_LONGLONG },
+  { "Pam_auth_attempts",              (char *) &pam_stats_calls[STAGE_LOGIN],         SHOW_LONGLONG },
+  { "Pam_auth_failures",              (char *) &pam_stats_failures[STAGE_LOGIN],      SHOW_LONGLONG },
+  { "Pam_auth_round_trips",           (char *) &pam_stats_calls[STAGE_CONVERSATION],  SHOW_LONGLONG },
+  { "Pam_auth_login_usec",            (char *) &pam_stats_usec[STAGE_LOGIN],          SHOW_LONGLONG },
+  { "Pam_auth_pam_start_usec",        (char *) &pam_stats_usec[STAGE_START],          SHOW_LONGLONG },
+  { "Pam_auth_pam_authenticate_usec", (char *) &pam_stats_usec[STAGE_AUTHENTICATE],   SHOW_LONGLONG },
+  { "Pam_auth_pam_acct_mgmt_usec",    (char *) &pam_stats_usec[STAGE_ACCT_MGMT],      SHOW_LONGLONG },
+  { "Pam_auth_conversation_usec",     (char *) &pam_stats_usec[STAGE_CONVERSATION],   SHOW_LONGLONG },
+  { 0, 0, SHOW_INT }
+};
+
 static struct st_mysql_auth pam_auth_handler =
 {
   MYSQL_AUTHENTICATION_INTERFACE_VERSION,       /* auth API version     */
@@ -112,6 +494,11 @@ static struct st_mysql_auth pam_auth_handler =
   pam_auth                                      /* main auth function   */
 };
 
+static struct st_mysql_information_schema pam_auth_is =
+{
+  MYSQL_INFORMATION_SCHEMA_INTERFACE_VERSION
+};
+
 mysql_declare_plugin(pam_auth)
 {
   MYSQL_AUTHENTICATION_PLUGIN,                  /* plugin type          */
@@ -120,7 +507,37 @@ mysql_declare_plugin(pam_auth)
   "Sergei Golubchik",                           /* author               */
   "PAM based authentication",                   /* description          */
   PLUGIN_LICENSE_GPL,                           /* license              */
-  NULL,                                         /* init function        */
+  pam_auth_init,                                /* init function        */
+  pam_auth_deinit,                              /* deinit function      */
+  0x0104,                                       /* version 1.4          */
+  pam_auth_status,                              /* for SHOW STATUS      */
+  pam_auth_sysvars,                             /* for SHOW VARIABLES   */
+  NULL,                                         /* unused               */
+  0,                                            /* flags                */
+},
+{
+  MYSQL_INFORMATION_SCHEMA_PLUGIN,              /* plugin type          */
+  &pam_auth_is,                                 /* descriptor           */
+  "PAM_AUTH_STATS",                             /* plugin name          */
+  "PaynetEasy",                                 /* author               */
+  "Calls, failures and latency of PAM logins by service and stage",
+  PLUGIN_LICENSE_GPL,                           /* license              */
+  pam_auth_stats_init,                          /* init function        */
+  NULL,                                         /* deinit function      */
+  0x0100,                                       /* version 1.0          */
+  NULL,                                         /* for SHOW STATUS      */
+  NULL,                                         /* for SHOW VARIABLES   */
+  NULL,                                         /* unused               */
+  0,                                            /* flags                */
+},
+{
+  MYSQL_INFORMATION_SCHEMA_PLUGIN,              /* plugin type          */
+  &pam_auth_is,                                 /* descriptor           */
+  "PAM_AUTH_ERRORS",                            /* plugin name          */
+  "PaynetEasy",                                 /* author               */
+  "Failed PAM logins by service, stage and error",
+  PLUGIN_LICENSE_GPL,                           /* license              */
+  pam_auth_errors_init,                         /* init function        */
   NULL,                                         /* deinit function      */
   0x0100,                                       /* version 1.0          */
   NULL,                                         /* for SHOW STATUS      */
@@ -0,0 +1,215 @@
+#ifndef PAM_AUTH_H
+#define PAM_AUTH_H
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: internal interfaces of the PAM authentication plugin.
+*/
+
+#include <time.h>
+#include <mysql/plugin_auth.h>
+#include <security/pam_appl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AUTH_CACHE_PROMPT_SIZE 256
+#define AUTH_CACHE_SECRET_SIZE 512
+
+struct pam_job;
+struct pam_service;
+
+/* conversation state shared by pam_auth() and the conv callback */
+struct param {
+  unsigned char buf[10240], *ptr;
+  MYSQL_PLUGIN_VIO *vio;
+
+  /* set when PAM runs on a pool worker, prompts go through the job */
+  struct pam_job *job;
+  /* statistics and circuit breaker of the PAM service */
+  struct pam_service *service;
+  /* time spent waiting for the client, not charged to the PAM backend */
+  long long conv_usec;
+  char authenticated_as[MYSQL_USERNAME_LENGTH + 1];
+
+  /* the first prompt sent and its reply, kept for the auth cache */
+  int cache;
+  int prompts;
+  unsigned char prompt[AUTH_CACHE_PROMPT_SIZE];
+  int prompt_len;
+  char reply[AUTH_CACHE_SECRET_SIZE];
+  int reply_len;
+
+  /* reply already read by the auth cache, answers the first prompt */
+  int replay;
+  /* the auth cache verified the password, only pam_acct_mgmt runs */
+  int account_only;
+};
+
+/* auth cache settings, see the pam_auth_cache_* system variables */
+extern char *auth_cache_services;
+extern unsigned int auth_cache_ttl;
+extern unsigned int auth_cache_size;
+extern unsigned int auth_cache_hash_rounds;
+
+/* worker pool and circuit breaker settings */
+extern unsigned int pam_auth_pool_size;
+extern unsigned int pam_auth_queue_size;
+extern unsigned int pam_auth_timeout;
+extern unsigned int breaker_threshold;
+extern unsigned int breaker_min_calls;
+extern unsigned int breaker_slow_time;
+extern unsigned int breaker_cooldown;
+
+/* failed login throttling settings */
+extern unsigned int throttle_host_threshold;
+extern unsigned int throttle_user_threshold;
+extern unsigned int throttle_window;
+extern unsigned int throttle_delay;
+
+/* auth cache counters for SHOW STATUS */
+extern volatile long long auth_cache_hits;
+extern volatile long long auth_cache_misses;
+
+enum auth_cache_result {
+  AUTH_CACHE_MISS,                              /* no entry, run PAM */
+  AUTH_CACHE_HIT,                               /* secret verified */
+  AUTH_CACHE_MISMATCH,                          /* reply read, run PAM with it */
+  AUTH_CACHE_ERROR                              /* client went away */
+};
+
+int auth_cache_init(void);
+void auth_cache_deinit(void);
+int auth_cache_enabled(const char *service);
+enum auth_cache_result auth_cache_verify(MYSQL_PLUGIN_VIO *vio,
+                                         MYSQL_SERVER_AUTH_INFO *info,
+                                         const char *service,
+                                         struct param *param);
+void auth_cache_store(const MYSQL_SERVER_AUTH_INFO *info, const char *service,
+                      const struct param *param);
+void auth_cache_invalidate(const char *user, const char *service);
+void wipe_memory(void *ptr, size_t len);
+
+/* worker pool counters for SHOW STATUS */
+extern volatile long long pam_pool_timeouts;
+extern volatile long long pam_pool_rejects;
+
+enum pam_job_result {
+  PAM_JOB_DONE,                                 /* PAM finished, see pam_job_status() */
+  PAM_JOB_BUSY,                                 /* queue is full, nothing was run */
+  PAM_JOB_TIMEOUT                               /* deadline passed, job abandoned */
+};
+
+int pam_pool_init(void);
+void pam_pool_deinit(void);
+struct pam_job *pam_job_new(const char *service, const char *user);
+struct param *pam_job_param(struct pam_job *job);
+int pam_job_status(struct pam_job *job);
+enum pam_job_result pam_job_run(struct pam_job *job, MYSQL_PLUGIN_VIO *vio,
+                                unsigned int timeout_ms);
+int pam_job_exchange(struct pam_job *job, const unsigned char *packet,
+                     int packet_len, unsigned char **reply);
+void pam_job_release(struct pam_job *job);
+
+/* runs one PAM transaction, defined in pam_auth.c */
+int pam_session(struct param *param, const char *service, const char *user);
+int pam_account_check(struct param *param, const char *service, const char *user);
+
+/* circuit breaker counters for SHOW STATUS */
+extern volatile long long breaker_rejects;
+extern volatile long long breaker_trips;
+
+enum breaker_outcome {
+  BREAKER_SUCCESS,                              /* backend answered */
+  BREAKER_FAILURE,                              /* backend failed or timed out */
+  BREAKER_NEUTRAL                               /* nothing learned about the backend */
+};
+
+/* stages of a login timed separately */
+enum pam_stage {
+  STAGE_LOGIN,                                  /* whole authenticate_user call */
+  STAGE_START,
+  STAGE_AUTHENTICATE,                           /* without the conversation */
+  STAGE_ACCT_MGMT,
+  STAGE_CONVERSATION,                           /* one prompt round-trip to the client */
+  PAM_STAGES
+};
+
+/* failures that are not PAM error codes */
+enum pam_stats_error {
+  ERROR_TIMEOUT = _PAM_RETURN_VALUES,
+  ERROR_QUEUE_FULL,
+  ERROR_BREAKER_OPEN,
+  ERROR_CLIENT,
+  ERROR_THROTTLED,
+  PAM_STATS_ERRORS
+};
+
+/* latency in log2 microsecond buckets, updated with atomic adds */
+#define PAM_STATS_BUCKETS 32
+
+struct pam_stage_stats {
+  volatile long long calls;
+  volatile long long failures;
+  volatile long long total_usec;
+  volatile long long max_usec;
+  volatile long long buckets[PAM_STATS_BUCKETS];
+  volatile long long errors[PAM_STATS_ERRORS];
+};
+
+#define PAM_SERVICE_NAME_SIZE 64
+
+struct pam_service_stats {
+  char name[PAM_SERVICE_NAME_SIZE];
+  struct pam_stage_stats stages[PAM_STAGES];
+};
+
+/* totals over all services for SHOW STATUS */
+extern volatile long long pam_stats_calls[PAM_STAGES];
+extern volatile long long pam_stats_failures[PAM_STAGES];
+extern volatile long long pam_stats_usec[PAM_STAGES];
+
+void pam_services_init(void);
+struct pam_service *pam_service_get(const char *name);
+int breaker_allow(struct pam_service *service);
+void breaker_record(struct pam_service *service, enum breaker_outcome outcome,
+                    long long backend_usec);
+void pam_stats_record(struct pam_service *service, enum pam_stage stage,
+                      int error, long long usec);
+unsigned int pam_services_count(void);
+const struct pam_service_stats *pam_service_stats_at(unsigned int i);
+const char *pam_stage_name(int stage);
+const char *pam_error_name(int error);
+
+/* failed login throttling counters for SHOW STATUS */
+extern volatile long long throttle_rejects;
+extern volatile long long throttle_delays;
+
+enum throttle_result {
+  THROTTLE_PASS,
+  THROTTLE_DELAYED,                             /* slept pam_auth_throttle_delay */
+  THROTTLE_REJECT
+};
+
+void throttle_init(void);
+int throttle_enabled(void);
+enum throttle_result throttle_check(const char *user, const char *host);
+void throttle_record_failure(const char *user, const char *host);
+
+/* INFORMATION_SCHEMA tables, defined in pam_auth_is.cc */
+int pam_auth_stats_init(void *p);
+int pam_auth_errors_init(void *p);
+
+static inline long long monotonic_usec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,406 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: cache of successful PAM authentications.
+
+   A successful login whose PAM conversation asked exactly one question
+   is remembered as (user, service) -> prompt, salted SHA-512 crypt of
+   the reply, authenticated_as.  The next login of the same user sends
+   the remembered prompt itself and verifies the reply against the hash,
+   skipping pam_authenticate; pam_acct_mgmt still runs, so a locked or
+   expired account is refused.  A wrong reply, or any PAM failure, drops
+   the entry.
+
+   Entries are preallocated and split across shards, each with its own
+   lock, hash chains and LRU list.
+*/
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <crypt.h>                              // crypt_r
+#include "pam_auth.h"
+
+#define AUTH_CACHE_SHARDS 16
+#define AUTH_CACHE_SERVICE_SIZE 64
+#define AUTH_CACHE_HASH_SIZE 128
+#define AUTH_CACHE_SALT_SIZE 16
+
+struct auth_cache_entry {
+  struct auth_cache_entry *lru_prev, *lru_next;   /* most recent first */
+  struct auth_cache_entry *hash_next;
+  unsigned int key_hash;
+  time_t expires;
+  char user[MYSQL_USERNAME_LENGTH + 1];
+  char service[AUTH_CACHE_SERVICE_SIZE];
+  char authenticated_as[MYSQL_USERNAME_LENGTH + 1];
+  unsigned char prompt[AUTH_CACHE_PROMPT_SIZE];
+  int prompt_len;
+  char secret_hash[AUTH_CACHE_HASH_SIZE];
+};
+
+struct auth_cache_shard {
+  pthread_mutex_t lock;
+  struct auth_cache_entry **buckets;
+  unsigned int bucket_mask;
+  struct auth_cache_entry *lru_head, *lru_tail;
+  struct auth_cache_entry *free_list;
+};
+
+static struct auth_cache_shard shards[AUTH_CACHE_SHARDS];
+static struct auth_cache_entry *entries = NULL;
+static unsigned int entries_count = 0;
+
+volatile long long auth_cache_hits;
+volatile long long auth_cache_misses;
+
+void wipe_memory(void *ptr, size_t len)
+{
+  volatile unsigned char *p = (volatile unsigned char *)ptr;
+  while (len--)
+    *p++ = 0;
+}
+
+static unsigned int key_hash(const char *user, const char *service)
+{
+  unsigned int hash = 2166136261U;
+  for (; *user; user++)
+    hash = (hash ^ (unsigned char)*user) * 16777619U;
+  hash = (hash ^ 0xff) * 16777619U;
+  for (; *service; service++)
+    hash = (hash ^ (unsigned char)*service) * 16777619U;
+  return hash;
+}
+
+static struct auth_cache_shard *shard_of(unsigned int hash)
+{
+  return &shards[hash % AUTH_CACHE_SHARDS];
+}
+
+int auth_cache_enabled(const char *service)
+{
+  size_t len = strlen(service);
+  const char *p = auth_cache_services;
+
+  if (!p || !auth_cache_ttl || !entries)
+    return 0;
+
+  /* auth_cache_services is a comma separated list of service names */
+  while (*p) {
+    size_t token = strcspn(p, ", ");
+    if (token == len && !strncmp(p, service, len))
+      return 1;
+    p += token;
+    p += strspn(p, ", ");
+  }
+  return 0;
+}
+
+int auth_cache_init(void)
+{
+  unsigned int per_shard, buckets, i, j;
+
+  if (!auth_cache_size)
+    return 0;
+
+  per_shard = (auth_cache_size + AUTH_CACHE_SHARDS - 1) / AUTH_CACHE_SHARDS;
+  for (buckets = 1; buckets < per_shard; buckets <<= 1)
+    ;
+
+  entries_count = per_shard * AUTH_CACHE_SHARDS;
+  entries = calloc(entries_count, sizeof(struct auth_cache_entry));
+  if (!entries)
+    return 1;
+
+  for (i = 0; i < AUTH_CACHE_SHARDS; i++) {
+    struct auth_cache_shard *shard = &shards[i];
+    pthread_mutex_init(&shard->lock, NULL);
+    shard->buckets = calloc(buckets, sizeof(struct auth_cache_entry *));
+    if (!shard->buckets) {
+      /* undo the shards set up so far, this one included */
+      do {
+        pthread_mutex_destroy(&shards[i].lock);
+        free(shards[i].buckets);
+        shards[i].buckets = NULL;
+      } while (i-- > 0);
+      free(entries);
+      entries = NULL;
+      return 1;
+    }
+    shard->bucket_mask = buckets - 1;
+    shard->lru_head = shard->lru_tail = NULL;
+    shard->free_list = NULL;
+    for (j = 0; j < per_shard; j++) {
+      struct auth_cache_entry *entry = &entries[i * per_shard + j];
+      entry->hash_next = shard->free_list;
+      shard->free_list = entry;
+    }
+  }
+  auth_cache_hits = 0;
+  auth_cache_misses = 0;
+  return 0;
+}
+
+void auth_cache_deinit(void)
+{
+  int i;
+
+  if (!entries)
+    return;
+  for (i = 0; i < AUTH_CACHE_SHARDS; i++) {
+    pthread_mutex_destroy(&shards[i].lock);
+    free(shards[i].buckets);
+    shards[i].buckets = NULL;
+  }
+  wipe_memory(entries, entries_count * sizeof(struct auth_cache_entry));
+  free(entries);
+  entries = NULL;
+}
+
+/* the functions below expect the shard lock to be held */
+
+static struct auth_cache_entry **find_slot(struct auth_cache_shard *shard,
+                                           unsigned int hash,
+                                           const char *user, const char *service)
+{
+  struct auth_cache_entry **slot = &shard->buckets[hash & shard->bucket_mask];
+  for (; *slot; slot = &(*slot)->hash_next)
+    if ((*slot)->key_hash == hash && !strcmp((*slot)->user, user) &&
+        !strcmp((*slot)->service, service))
+      break;
+  return slot;
+}
+
+static void lru_unlink(struct auth_cache_shard *shard, struct auth_cache_entry *entry)
+{
+  if (entry->lru_prev)
+    entry->lru_prev->lru_next = entry->lru_next;
+  else
+    shard->lru_head = entry->lru_next;
+  if (entry->lru_next)
+    entry->lru_next->lru_prev = entry->lru_prev;
+  else
+    shard->lru_tail = entry->lru_prev;
+}
+
+static void lru_push(struct auth_cache_shard *shard, struct auth_cache_entry *entry)
+{
+  entry->lru_prev = NULL;
+  entry->lru_next = shard->lru_head;
+  if (shard->lru_head)
+    shard->lru_head->lru_prev = entry;
+  shard->lru_head = entry;
+  if (!shard->lru_tail)
+    shard->lru_tail = entry;
+}
+
+static void remove_entry(struct auth_cache_shard *shard,
+                         struct auth_cache_entry **slot)
+{
+  struct auth_cache_entry *entry = *slot;
+  *slot = entry->hash_next;
+  lru_unlink(shard, entry);
+  wipe_memory(entry, sizeof(*entry));
+  entry->hash_next = shard->free_list;
+  shard->free_list = entry;
+}
+
+void auth_cache_invalidate(const char *user, const char *service)
+{
+  unsigned int hash;
+  struct auth_cache_shard *shard;
+  struct auth_cache_entry **slot;
+
+  if (!entries)
+    return;
+  hash = key_hash(user, service);
+  shard = shard_of(hash);
+  pthread_mutex_lock(&shard->lock);
+  slot = find_slot(shard, hash, user, service);
+  if (*slot)
+    remove_entry(shard, slot);
+  pthread_mutex_unlock(&shard->lock);
+}
+
+/* SHA-512 crypt; the setting is either a fresh "$6$rounds=N$salt" or a stored hash */
+static int hash_secret(const char *secret, const char *setting,
+                       char *out, size_t out_size)
+{
+  struct crypt_data *data = calloc(1, sizeof(struct crypt_data));
+  const char *hash;
+  int error = 1;
+
+  if (!data)
+    return 1;
+  hash = crypt_r(secret, setting, data);
+  if (hash && hash[0] == '$' && strlen(hash) < out_size) {
+    strcpy(out, hash);
+    error = 0;
+  }
+  wipe_memory(data, sizeof(*data));
+  free(data);
+  return error;
+}
+
+static int make_setting(char *setting, size_t size)
+{
+  static const char alphabet[] =
+    "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+  unsigned char random[AUTH_CACHE_SALT_SIZE];
+  char salt[AUTH_CACHE_SALT_SIZE + 1];
+  int fd = open("/dev/urandom", O_RDONLY);
+  int i;
+
+  if (fd < 0)
+    return 1;
+  if (read(fd, random, sizeof(random)) != sizeof(random)) {
+    close(fd);
+    return 1;
+  }
+  close(fd);
+  for (i = 0; i < AUTH_CACHE_SALT_SIZE; i++)
+    salt[i] = alphabet[random[i] & 63];
+  salt[AUTH_CACHE_SALT_SIZE] = 0;
+  snprintf(setting, size, "$6$rounds=%u$%s", auth_cache_hash_rounds, salt);
+  return 0;
+}
+
+static int constant_time_differs(const char *a, const char *b)
+{
+  size_t len_a = strlen(a), len_b = strlen(b), i;
+  unsigned char diff = len_a != len_b;
+  for (i = 0; i < len_a && i < len_b; i++)
+    diff |= a[i] ^ b[i];
+  return diff != 0;
+}
+
+/*
+  Look the user up; on a live entry run the cached dialog with the client.
+  The reply is left in param->reply, so that on a mismatch PAM can be
+  answered with it instead of asking the client a second time.
+*/
+enum auth_cache_result auth_cache_verify(MYSQL_PLUGIN_VIO *vio,
+                                         MYSQL_SERVER_AUTH_INFO *info,
+                                         const char *service,
+                                         struct param *param)
+{
+  unsigned int hash = key_hash(info->user_name, service);
+  struct auth_cache_shard *shard = shard_of(hash);
+  struct auth_cache_entry **slot, *entry;
+  char secret_hash[AUTH_CACHE_HASH_SIZE], computed[AUTH_CACHE_HASH_SIZE];
+  char authenticated_as[MYSQL_USERNAME_LENGTH + 1];
+  unsigned char *pkt;
+  int pkt_len, mismatch;
+
+  pthread_mutex_lock(&shard->lock);
+  slot = find_slot(shard, hash, info->user_name, service);
+  entry = *slot;
+  if (entry && entry->expires <= time(NULL)) {
+    remove_entry(shard, slot);
+    entry = NULL;
+  }
+  if (!entry) {
+    pthread_mutex_unlock(&shard->lock);
+    __sync_fetch_and_add(&auth_cache_misses, 1);
+    return AUTH_CACHE_MISS;
+  }
+  memcpy(param->prompt, entry->prompt, entry->prompt_len);
+  param->prompt_len = entry->prompt_len;
+  strcpy(secret_hash, entry->secret_hash);
+  strcpy(authenticated_as, entry->authenticated_as);
+  pthread_mutex_unlock(&shard->lock);
+
+  /* the same dialog packet PAM produced when the entry was stored */
+  if (vio->write_packet(vio, param->prompt, param->prompt_len))
+    return AUTH_CACHE_ERROR;
+  pkt_len = vio->read_packet(vio, &pkt);
+  if (pkt_len < 0)
+    return AUTH_CACHE_ERROR;
+  if (pkt_len >= AUTH_CACHE_SECRET_SIZE)
+    pkt_len = AUTH_CACHE_SECRET_SIZE - 1;
+  memcpy(param->reply, pkt, pkt_len);
+  param->reply[pkt_len] = 0;
+  param->reply_len = pkt_len;
+
+  mismatch = hash_secret(param->reply, secret_hash, computed, sizeof(computed)) ||
+             constant_time_differs(computed, secret_hash);
+  wipe_memory(computed, sizeof(computed));
+
+  if (mismatch) {
+    auth_cache_invalidate(info->user_name, service);
+    __sync_fetch_and_add(&auth_cache_misses, 1);
+    param->replay = 1;
+    return AUTH_CACHE_MISMATCH;
+  }
+
+  memcpy(info->authenticated_as, authenticated_as, strlen(authenticated_as) + 1);
+  wipe_memory(param->reply, sizeof(param->reply));
+
+  pthread_mutex_lock(&shard->lock);
+  slot = find_slot(shard, hash, info->user_name, service);
+  if (*slot) {
+    lru_unlink(shard, *slot);
+    lru_push(shard, *slot);
+  }
+  pthread_mutex_unlock(&shard->lock);
+  __sync_fetch_and_add(&auth_cache_hits, 1);
+  return AUTH_CACHE_HIT;
+}
+
+/* remember a successful single-prompt conversation */
+void auth_cache_store(const MYSQL_SERVER_AUTH_INFO *info, const char *service,
+                      const struct param *param)
+{
+  unsigned int hash;
+  struct auth_cache_shard *shard;
+  struct auth_cache_entry **slot, *entry;
+  char setting[64], secret_hash[AUTH_CACHE_HASH_SIZE];
+  size_t user_len = strlen(info->user_name);
+  size_t service_len = strlen(service);
+  size_t authenticated_as_len = strlen(info->authenticated_as);
+
+  if (param->prompts != 1 || !param->prompt_len ||
+      user_len >= sizeof(((struct auth_cache_entry *)0)->user) ||
+      service_len >= AUTH_CACHE_SERVICE_SIZE ||
+      authenticated_as_len >= sizeof(((struct auth_cache_entry *)0)->authenticated_as) ||
+      make_setting(setting, sizeof(setting)) ||
+      hash_secret(param->reply, setting, secret_hash, sizeof(secret_hash)))
+    return;
+
+  hash = key_hash(info->user_name, service);
+  shard = shard_of(hash);
+  pthread_mutex_lock(&shard->lock);
+  slot = find_slot(shard, hash, info->user_name, service);
+  if (*slot)
+    remove_entry(shard, slot);
+  if (!shard->free_list) {
+    /* evict the least recently used entry of the shard */
+    struct auth_cache_entry *victim = shard->lru_tail;
+    remove_entry(shard, find_slot(shard, victim->key_hash, victim->user, victim->service));
+  }
+  entry = shard->free_list;
+  shard->free_list = entry->hash_next;
+
+  entry->key_hash = hash;
+  entry->expires = time(NULL) + auth_cache_ttl;
+  memcpy(entry->user, info->user_name, user_len);
+  entry->user[user_len] = 0;
+  memcpy(entry->service, service, service_len);
+  entry->service[service_len] = 0;
+  memcpy(entry->authenticated_as, info->authenticated_as, authenticated_as_len);
+  entry->authenticated_as[authenticated_as_len] = 0;
+  memcpy(entry->prompt, param->prompt, param->prompt_len);
+  entry->prompt_len = param->prompt_len;
+  strcpy(entry->secret_hash, secret_hash);
+
+  slot = &shard->buckets[hash & shard->bucket_mask];
+  entry->hash_next = *slot;
+  *slot = entry;
+  lru_push(shard, entry);
+  pthread_mutex_unlock(&shard->lock);
+  wipe_memory(secret_hash, sizeof(secret_hash));
+}
@@ -0,0 +1,147 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: INFORMATION_SCHEMA tables of the PAM authentication plugin.
+
+   PAM_AUTH_STATS has one row per service and login stage with call
+   counts and latency percentiles, PAM_AUTH_ERRORS one row per service,
+   stage and error that occurred.  Percentiles are upper bounds of the
+   log2 microsecond histogram buckets, capped at the maximum seen.
+*/
+#include "sql_class.h"                          // TABLE
+#include <mysql/plugin.h>
+#include "my_global.h"
+#include "pam_auth.h"
+
+bool schema_table_store_record(THD *thd, TABLE *table);
+
+ST_FIELD_INFO pam_auth_stats_fields[]=
+{
+  {"SERVICE", PAM_SERVICE_NAME_SIZE, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"STAGE", 32, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"CALLS", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"FAILURES", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"TOTAL_USEC", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"AVG_USEC", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"P50_USEC", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"P95_USEC", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"P99_USEC", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"MAX_USEC", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {0, 0, MYSQL_TYPE_NULL, 0, 0, 0, 0}
+};
+
+ST_FIELD_INFO pam_auth_errors_fields[]=
+{
+  {"SERVICE", PAM_SERVICE_NAME_SIZE, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"STAGE", 32, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"ERROR", 32, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"COUNT", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {0, 0, MYSQL_TYPE_NULL, 0, 0, 0, 0}
+};
+
+static longlong percentile(const longlong *buckets, longlong calls,
+                           longlong max_usec, uint percent)
+{
+  longlong rank= (calls * percent + 99) / 100, seen= 0;
+  for (int i= 0; i < PAM_STATS_BUCKETS; i++)
+  {
+    seen+= buckets[i];
+    if (seen >= rank)
+      return min(1LL << i, max_usec);
+  }
+  return max_usec;
+}
+
+#if MYSQL_VERSION_ID > 50600
+static int fill_pam_auth_stats(THD *thd, TABLE_LIST *tables, Item *item)
+#else
+static int fill_pam_auth_stats(THD *thd, TABLE_LIST *tables, COND *cond)
+#endif
+{
+  CHARSET_INFO *cs= system_charset_info;
+  TABLE *table= tables->table;
+  uint count= pam_services_count();
+
+  for (uint i= 0; i < count; i++)
+  {
+    const pam_service_stats *service= pam_service_stats_at(i);
+    for (int stage= 0; stage < PAM_STAGES; stage++)
+    {
+      const pam_stage_stats *st= &service->stages[stage];
+      longlong buckets[PAM_STATS_BUCKETS], calls= 0;
+
+      /* a consistent enough copy, counters keep moving while we read */
+      for (int b= 0; b < PAM_STATS_BUCKETS; b++)
+        calls+= buckets[b]= st->buckets[b];
+      if (!calls)
+        continue;
+
+      longlong total= st->total_usec, max_usec= st->max_usec;
+      const char *name= pam_stage_name(stage);
+      table->field[0]->store(service->name, strlen(service->name), cs);
+      table->field[1]->store(name, strlen(name), cs);
+      table->field[2]->store(calls, 1);
+      table->field[3]->store(st->failures, 1);
+      table->field[4]->store(total, 1);
+      table->field[5]->store(total / calls, 1);
+      table->field[6]->store(percentile(buckets, calls, max_usec, 50), 1);
+      table->field[7]->store(percentile(buckets, calls, max_usec, 95), 1);
+      table->field[8]->store(percentile(buckets, calls, max_usec, 99), 1);
+      table->field[9]->store(max_usec, 1);
+      if (schema_table_store_record(thd, table))
+        return 1;
+    }
+  }
+  return 0;
+}
+
+#if MYSQL_VERSION_ID > 50600
+static int fill_pam_auth_errors(THD *thd, TABLE_LIST *tables, Item *item)
+#else
+static int fill_pam_auth_errors(THD *thd, TABLE_LIST *tables, COND *cond)
+#endif
+{
+  CHARSET_INFO *cs= system_charset_info;
+  TABLE *table= tables->table;
+  uint count= pam_services_count();
+
+  for (uint i= 0; i < count; i++)
+  {
+    const pam_service_stats *service= pam_service_stats_at(i);
+    for (int stage= 0; stage < PAM_STAGES; stage++)
+    {
+      for (int error= 0; error < PAM_STATS_ERRORS; error++)
+      {
+        longlong errors= service->stages[stage].errors[error];
+        if (!errors)
+          continue;
+
+        const char *stage_name= pam_stage_name(stage);
+        const char *error_name= pam_error_name(error);
+        table->field[0]->store(service->name, strlen(service->name), cs);
+        table->field[1]->store(stage_name, strlen(stage_name), cs);
+        table->field[2]->store(error_name, strlen(error_name), cs);
+        table->field[3]->store(errors, 1);
+        if (schema_table_store_record(thd, table))
+          return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+int pam_auth_stats_init(void *p)
+{
+  ST_SCHEMA_TABLE *schema= (ST_SCHEMA_TABLE*) p;
+  schema->fields_info= pam_auth_stats_fields;
+  schema->fill_table= fill_pam_auth_stats;
+  return 0;
+}
+
+int pam_auth_errors_init(void *p)
+{
+  ST_SCHEMA_TABLE *schema= (ST_SCHEMA_TABLE*) p;
+  schema->fields_info= pam_auth_errors_fields;
+  schema->fill_table= fill_pam_auth_errors;
+  return 0;
+}
@@ -0,0 +1,320 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: worker pool running PAM transactions.
+
+   pam_authenticate() can block for as long as the directory server
+   behind PAM does.  Running it on a small fixed set of workers keeps
+   connection threads free to give up at a deadline: the connection
+   thread queues a job, relays the prompts of the PAM conversation
+   through MYSQL_PLUGIN_VIO, and abandons the job when the deadline
+   passes.  An abandoned job is freed by whichever side lets go last.
+
+   One lock protects the queue and the state of every job; each job has
+   its own condition both sides wait on.
+
+   Shutdown waits POOL_SHUTDOWN_MS for the workers.  One still stuck in
+   PAM after that is detached and left behind, with the plugin library
+   pinned in memory so that it has code to return to.
+*/
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <syslog.h>
+#include <security/pam_appl.h>
+#include "pam_auth.h"
+
+#define PAM_JOB_REPLY_SIZE 4096
+#define POOL_SHUTDOWN_MS 5000
+
+enum pam_job_state {
+  JOB_QUEUED,
+  JOB_RUNNING,
+  JOB_PROMPT,                                   /* worker waits for the client reply */
+  JOB_REPLY,                                    /* reply is ready for the worker */
+  JOB_DONE
+};
+
+struct pam_job {
+  struct param param;
+  struct pam_job *next;
+  pthread_cond_t cond;
+  enum pam_job_state state;
+  int refs;
+  int abandoned;
+  char *service;
+  char *user;
+  int status;
+
+  /* one PAM prompt and the client reply to it */
+  const unsigned char *packet;
+  int packet_len;
+  unsigned char reply[PAM_JOB_REPLY_SIZE];
+  int reply_len;
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static pthread_condattr_t job_condattr;
+static struct pam_job *queue_head = NULL, *queue_tail = NULL;
+static unsigned int queue_length = 0;
+static pthread_t *workers = NULL;
+static unsigned int workers_count = 0;
+static int shutdown_pool = 0;
+
+volatile long long pam_pool_timeouts;
+volatile long long pam_pool_rejects;
+
+/* expects pool_lock to be held */
+static void job_unref(struct pam_job *job)
+{
+  if (--job->refs)
+    return;
+  pthread_cond_destroy(&job->cond);
+  free(job->service);
+  free(job->user);
+  wipe_memory(job, sizeof(*job));
+  free(job);
+}
+
+static void *pool_worker(void *arg)
+{
+  struct pam_job *job;
+  int status;
+
+  pthread_mutex_lock(&pool_lock);
+  for (;;) {
+    while (!queue_head && !shutdown_pool)
+      pthread_cond_wait(&pool_cond, &pool_lock);
+    if (!queue_head)
+      break;
+
+    job = queue_head;
+    queue_head = job->next;
+    if (!queue_head)
+      queue_tail = NULL;
+    queue_length--;
+
+    if (job->abandoned) {
+      job_unref(job);
+      continue;
+    }
+
+    job->state = JOB_RUNNING;
+    pthread_mutex_unlock(&pool_lock);
+
+    if (job->param.account_only)
+      status = pam_account_check(&job->param, job->service, job->user);
+    else
+      status = pam_session(&job->param, job->service, job->user);
+
+    pthread_mutex_lock(&pool_lock);
+    job->status = status;
+    job->state = JOB_DONE;
+    pthread_cond_broadcast(&job->cond);
+    job_unref(job);
+  }
+  pthread_mutex_unlock(&pool_lock);
+  return NULL;
+}
+
+int pam_pool_init(void)
+{
+  unsigned int i;
+
+  pam_pool_timeouts = 0;
+  pam_pool_rejects = 0;
+  shutdown_pool = 0;
+  workers_count = 0;
+
+  if (!pam_auth_pool_size)
+    return 0;
+
+  pthread_condattr_init(&job_condattr);
+  pthread_condattr_setclock(&job_condattr, CLOCK_MONOTONIC);
+
+  workers = calloc(pam_auth_pool_size, sizeof(pthread_t));
+  if (!workers)
+    return 1;
+  for (i = 0; i < pam_auth_pool_size; i++) {
+    if (pthread_create(&workers[i], NULL, pool_worker, NULL)) {
+      pam_pool_deinit();
+      return 1;
+    }
+    workers_count++;
+  }
+  return 0;
+}
+
+/* keeps this library mapped for workers that outlive the plugin */
+static void pin_library(void)
+{
+  Dl_info info;
+  if (dladdr((void *) &pin_library, &info) && info.dli_fname)
+    dlopen(info.dli_fname, RTLD_NOW | RTLD_NOLOAD | RTLD_NODELETE);
+}
+
+/* waits for the workers until POOL_SHUTDOWN_MS, then leaves hung ones behind */
+void pam_pool_deinit(void)
+{
+  struct timespec deadline;
+  unsigned int i, stuck = 0;
+
+  pthread_mutex_lock(&pool_lock);
+  shutdown_pool = 1;
+  pthread_cond_broadcast(&pool_cond);
+  pthread_mutex_unlock(&pool_lock);
+
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += POOL_SHUTDOWN_MS / 1000;
+  for (i = 0; i < workers_count; i++) {
+    if (!pthread_timedjoin_np(workers[i], NULL, &deadline))
+      continue;
+    pthread_detach(workers[i]);
+    stuck++;
+  }
+  if (stuck) {
+    pin_library();
+    syslog(LOG_WARNING, "pam_auth: %u PAM threads did not stop, left running", stuck);
+  }
+  free(workers);
+  workers = NULL;
+  workers_count = 0;
+}
+
+struct pam_job *pam_job_new(const char *service, const char *user)
+{
+  struct pam_job *job = calloc(1, sizeof(struct pam_job));
+  if (!job)
+    return NULL;
+  job->service = strdup(service);
+  job->user = strdup(user);
+  if (!job->service || !job->user) {
+    free(job->service);
+    free(job->user);
+    free(job);
+    return NULL;
+  }
+  pthread_cond_init(&job->cond, &job_condattr);
+  job->refs = 1;
+  job->state = JOB_QUEUED;
+  job->status = PAM_ABORT;
+  job->param.job = job;
+  return job;
+}
+
+struct param *pam_job_param(struct pam_job *job)
+{
+  return &job->param;
+}
+
+int pam_job_status(struct pam_job *job)
+{
+  return job->status;
+}
+
+void pam_job_release(struct pam_job *job)
+{
+  pthread_mutex_lock(&pool_lock);
+  job_unref(job);
+  pthread_mutex_unlock(&pool_lock);
+}
+
+/* relays one prompt to the client and reads the reply, connection thread */
+static void relay_prompt(struct pam_job *job, MYSQL_PLUGIN_VIO *vio)
+{
+  unsigned char *pkt;
+  int pkt_len = -1;
+
+  /* the worker is parked until the reply, packet stays valid */
+  pthread_mutex_unlock(&pool_lock);
+  if (!vio->write_packet(vio, job->packet, job->packet_len)) {
+    pkt_len = vio->read_packet(vio, &pkt);
+    if (pkt_len >= (int)sizeof(job->reply))
+      pkt_len = -1;
+    else if (pkt_len > 0)
+      memcpy(job->reply, pkt, pkt_len);
+  }
+  pthread_mutex_lock(&pool_lock);
+
+  job->reply_len = pkt_len;
+  job->state = JOB_REPLY;
+  pthread_cond_broadcast(&job->cond);
+}
+
+enum pam_job_result pam_job_run(struct pam_job *job, MYSQL_PLUGIN_VIO *vio,
+                                unsigned int timeout_ms)
+{
+  struct timespec deadline;
+  int rc = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  pthread_mutex_lock(&pool_lock);
+  if (!workers_count || queue_length >= pam_auth_queue_size) {
+    pthread_mutex_unlock(&pool_lock);
+    __sync_add_and_fetch(&pam_pool_rejects, 1);
+    return PAM_JOB_BUSY;
+  }
+
+  job->refs++;
+  job->next = NULL;
+  if (queue_tail)
+    queue_tail->next = job;
+  else
+    queue_head = job;
+  queue_tail = job;
+  queue_length++;
+  pthread_cond_signal(&pool_cond);
+
+  while (job->state != JOB_DONE) {
+    if (job->state == JOB_PROMPT) {
+      relay_prompt(job, vio);
+      continue;
+    }
+    if (timeout_ms)
+      rc = pthread_cond_timedwait(&job->cond, &pool_lock, &deadline);
+    else
+      pthread_cond_wait(&job->cond, &pool_lock);
+    if (rc == ETIMEDOUT && job->state != JOB_DONE) {
+      job->abandoned = 1;
+      pthread_cond_broadcast(&job->cond);
+      pthread_mutex_unlock(&pool_lock);
+      __sync_add_and_fetch(&pam_pool_timeouts, 1);
+      return PAM_JOB_TIMEOUT;
+    }
+  }
+  pthread_mutex_unlock(&pool_lock);
+  return PAM_JOB_DONE;
+}
+
+/* called from the conv callback on the worker, returns the reply length or -1 */
+int pam_job_exchange(struct pam_job *job, const unsigned char *packet,
+                     int packet_len, unsigned char **reply)
+{
+  int len;
+
+  pthread_mutex_lock(&pool_lock);
+  job->packet = packet;
+  job->packet_len = packet_len;
+  job->state = JOB_PROMPT;
+  pthread_cond_broadcast(&job->cond);
+  while (job->state == JOB_PROMPT && !job->abandoned)
+    pthread_cond_wait(&job->cond, &pool_lock);
+  len = job->abandoned ? -1 : job->reply_len;
+  job->state = JOB_RUNNING;
+  pthread_mutex_unlock(&pool_lock);
+
+  *reply = job->reply;
+  return len;
+}
@@ -0,0 +1,287 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: per PAM service state, statistics and circuit breaker.
+
+   Every PAM service seen in an authentication string gets a slot in a
+   small fixed table.  The breaker of a service counts attempts and
+   backend failures (errors, timeouts, answers slower than
+   pam_auth_breaker_slow_time) over a fixed window.  When failures reach
+   pam_auth_breaker_threshold percent of at least pam_auth_breaker_min_calls
+   attempts the breaker opens and logins to that service fail at once.
+   After pam_auth_breaker_cooldown seconds one probe login is let through;
+   its outcome closes the breaker or opens it again.
+
+   Statistics count calls, failures by error and latency histograms for
+   every stage of a login.  Slots are never freed, so once a login has
+   looked up its service the counters are updated with atomic adds and
+   read without locks.
+*/
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <syslog.h>
+#include "pam_auth.h"
+
+#define PAM_SERVICES_MAX 64
+#define BREAKER_WINDOW_USEC 10000000LL
+
+enum breaker_state { BREAKER_CLOSED, BREAKER_OPEN, BREAKER_HALF_OPEN };
+
+struct pam_service {
+  struct pam_service_stats stats;
+  enum breaker_state state;
+  long long opened_at;
+  long long window_start;
+  unsigned int calls;
+  unsigned int failures;
+  int probing;
+};
+
+static pthread_mutex_t services_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pam_service services[PAM_SERVICES_MAX];
+static unsigned int services_count = 0;
+
+volatile long long breaker_rejects;
+volatile long long breaker_trips;
+
+volatile long long pam_stats_calls[PAM_STAGES];
+volatile long long pam_stats_failures[PAM_STAGES];
+volatile long long pam_stats_usec[PAM_STAGES];
+
+static const char *stage_names[PAM_STAGES] = {
+  "login", "pam_start", "pam_authenticate", "pam_acct_mgmt", "conversation"
+};
+
+#define ERROR_NAME(X) [X] = #X
+static const char *error_names[PAM_STATS_ERRORS] = {
+  ERROR_NAME(PAM_SUCCESS),
+  ERROR_NAME(PAM_OPEN_ERR),
+  ERROR_NAME(PAM_SYMBOL_ERR),
+  ERROR_NAME(PAM_SERVICE_ERR),
+  ERROR_NAME(PAM_SYSTEM_ERR),
+  ERROR_NAME(PAM_BUF_ERR),
+  ERROR_NAME(PAM_PERM_DENIED),
+  ERROR_NAME(PAM_AUTH_ERR),
+  ERROR_NAME(PAM_CRED_INSUFFICIENT),
+  ERROR_NAME(PAM_AUTHINFO_UNAVAIL),
+  ERROR_NAME(PAM_USER_UNKNOWN),
+  ERROR_NAME(PAM_MAXTRIES),
+  ERROR_NAME(PAM_NEW_AUTHTOK_REQD),
+  ERROR_NAME(PAM_ACCT_EXPIRED),
+  ERROR_NAME(PAM_SESSION_ERR),
+  ERROR_NAME(PAM_CRED_UNAVAIL),
+  ERROR_NAME(PAM_CRED_EXPIRED),
+  ERROR_NAME(PAM_CRED_ERR),
+  ERROR_NAME(PAM_NO_MODULE_DATA),
+  ERROR_NAME(PAM_CONV_ERR),
+  ERROR_NAME(PAM_AUTHTOK_ERR),
+  ERROR_NAME(PAM_AUTHTOK_RECOVERY_ERR),
+  ERROR_NAME(PAM_AUTHTOK_LOCK_BUSY),
+  ERROR_NAME(PAM_AUTHTOK_DISABLE_AGING),
+  ERROR_NAME(PAM_TRY_AGAIN),
+  ERROR_NAME(PAM_IGNORE),
+  ERROR_NAME(PAM_ABORT),
+  ERROR_NAME(PAM_AUTHTOK_EXPIRED),
+  ERROR_NAME(PAM_MODULE_UNKNOWN),
+  ERROR_NAME(PAM_BAD_ITEM),
+  ERROR_NAME(PAM_CONV_AGAIN),
+  ERROR_NAME(PAM_INCOMPLETE),
+  [ERROR_TIMEOUT] = "TIMEOUT",
+  [ERROR_QUEUE_FULL] = "QUEUE_FULL",
+  [ERROR_BREAKER_OPEN] = "BREAKER_OPEN",
+  [ERROR_CLIENT] = "CLIENT_ERROR",
+  [ERROR_THROTTLED] = "THROTTLED"
+};
+
+void pam_services_init(void)
+{
+  pthread_mutex_lock(&services_lock);
+  memset(services, 0, sizeof(services));
+  services_count = 0;
+  pthread_mutex_unlock(&services_lock);
+  breaker_rejects = 0;
+  breaker_trips = 0;
+  memset((void *)pam_stats_calls, 0, sizeof(pam_stats_calls));
+  memset((void *)pam_stats_failures, 0, sizeof(pam_stats_failures));
+  memset((void *)pam_stats_usec, 0, sizeof(pam_stats_usec));
+}
+
+/* NULL when the table is full, such logins only count in the totals */
+struct pam_service *pam_service_get(const char *service)
+{
+  char name[PAM_SERVICE_NAME_SIZE];
+  struct pam_service *s = NULL;
+  unsigned int i;
+
+  snprintf(name, sizeof(name), "%s", service);
+  pthread_mutex_lock(&services_lock);
+  for (i = 0; i < services_count; i++)
+    if (!strcmp(services[i].stats.name, name)) {
+      s = &services[i];
+      break;
+    }
+  if (!s && services_count < PAM_SERVICES_MAX) {
+    s = &services[services_count];
+    memcpy(s->stats.name, name, sizeof(name));
+    /* lock-free readers must see the name before the new count */
+    __sync_synchronize();
+    services_count++;
+  }
+  pthread_mutex_unlock(&services_lock);
+  return s;
+}
+
+unsigned int pam_services_count(void)
+{
+  unsigned int count = services_count;
+  __sync_synchronize();
+  return count;
+}
+
+const struct pam_service_stats *pam_service_stats_at(unsigned int i)
+{
+  return &services[i].stats;
+}
+
+const char *pam_stage_name(int stage)
+{
+  return stage_names[stage];
+}
+
+const char *pam_error_name(int error)
+{
+  return error_names[error] ? error_names[error] : "UNKNOWN";
+}
+
+void pam_stats_record(struct pam_service *s, enum pam_stage stage,
+                      int error, long long usec)
+{
+  struct pam_stage_stats *st;
+  long long max;
+  int bucket = 0;
+
+  if (usec < 0)
+    usec = 0;
+  if (error < 0 || error >= PAM_STATS_ERRORS)
+    error = PAM_SYSTEM_ERR;
+
+  __sync_add_and_fetch(&pam_stats_calls[stage], 1);
+  __sync_add_and_fetch(&pam_stats_usec[stage], usec);
+  if (error != PAM_SUCCESS)
+    __sync_add_and_fetch(&pam_stats_failures[stage], 1);
+
+  if (!s)
+    return;
+
+  /* bucket i holds latencies below 2^i microseconds */
+  while (bucket < PAM_STATS_BUCKETS - 1 && (1LL << bucket) <= usec)
+    bucket++;
+
+  st = &s->stats.stages[stage];
+  __sync_add_and_fetch(&st->calls, 1);
+  __sync_add_and_fetch(&st->total_usec, usec);
+  __sync_add_and_fetch(&st->buckets[bucket], 1);
+  if (error != PAM_SUCCESS) {
+    __sync_add_and_fetch(&st->failures, 1);
+    __sync_add_and_fetch(&st->errors[error], 1);
+  }
+  while ((max = st->max_usec) < usec &&
+         !__sync_bool_compare_and_swap(&st->max_usec, max, usec))
+    ;
+}
+
+static void breaker_open(struct pam_service *s, long long now)
+{
+  s->state = BREAKER_OPEN;
+  s->opened_at = now;
+  s->probing = 0;
+  __sync_add_and_fetch(&breaker_trips, 1);
+  syslog(LOG_WARNING, "[AUTH BREAKER] Service: %s, state: open", s->stats.name);
+}
+
+static void breaker_close(struct pam_service *s, long long now)
+{
+  s->state = BREAKER_CLOSED;
+  s->window_start = now;
+  s->calls = 0;
+  s->failures = 0;
+  s->probing = 0;
+  syslog(LOG_WARNING, "[AUTH BREAKER] Service: %s, state: closed", s->stats.name);
+}
+
+int breaker_allow(struct pam_service *s)
+{
+  int allow = 1;
+
+  if (!breaker_threshold || !s)
+    return 1;
+
+  pthread_mutex_lock(&services_lock);
+  switch (s->state) {
+  case BREAKER_CLOSED:
+    break;
+  case BREAKER_OPEN:
+    if (monotonic_usec() - s->opened_at >= breaker_cooldown * 1000000LL) {
+      s->state = BREAKER_HALF_OPEN;
+      s->probing = 1;
+    } else
+      allow = 0;
+    break;
+  case BREAKER_HALF_OPEN:
+    if (s->probing)
+      allow = 0;
+    else
+      s->probing = 1;
+    break;
+  }
+  pthread_mutex_unlock(&services_lock);
+
+  if (!allow)
+    __sync_add_and_fetch(&breaker_rejects, 1);
+  return allow;
+}
+
+void breaker_record(struct pam_service *s, enum breaker_outcome outcome,
+                    long long backend_usec)
+{
+  long long now = monotonic_usec();
+  int failed = outcome == BREAKER_FAILURE ||
+               (breaker_slow_time && backend_usec >= breaker_slow_time * 1000LL);
+
+  if (!s)
+    return;
+
+  pthread_mutex_lock(&services_lock);
+  if (outcome == BREAKER_NEUTRAL) {
+    s->probing = 0;
+    goto end;
+  }
+
+  switch (s->state) {
+  case BREAKER_HALF_OPEN:
+    if (failed)
+      breaker_open(s, now);
+    else
+      breaker_close(s, now);
+    break;
+  case BREAKER_CLOSED:
+    if (now - s->window_start >= BREAKER_WINDOW_USEC) {
+      s->window_start = now;
+      s->calls = 0;
+      s->failures = 0;
+    }
+    s->calls++;
+    s->failures += failed;
+    if (breaker_threshold && s->calls >= breaker_min_calls &&
+        s->failures * 100ULL >= (unsigned long long)breaker_threshold * s->calls)
+      breaker_open(s, now);
+    break;
+  case BREAKER_OPEN:
+    /* late results of logins admitted before the breaker opened */
+    break;
+  }
+
+end:
+  pthread_mutex_unlock(&services_lock);
+}
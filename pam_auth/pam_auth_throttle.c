@@ -0,0 +1,168 @@
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: throttling of clients that keep failing to log in.
+
+   Failed logins are counted per client host and per user@host in a
+   count-min sketch: a fixed table of counters, a few rows indexed by
+   independent hashes of the key, the estimate being the smallest of
+   the counters of the key.  Memory does not grow with the number of
+   clients, and the estimate can only err upwards.
+
+   Two sketches cover the current and the previous window of
+   pam_auth_throttle_window seconds; a key is over its threshold when
+   the sum of both is.  The older sketch is cleared when its window
+   comes around again.
+
+   A delayed login sleeps on its connection thread, so the delay is
+   capped by its variable and at most THROTTLE_MAX_SLEEPERS logins sleep
+   at once; the ones beyond that are rejected.
+*/
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "pam_auth.h"
+
+#define SKETCH_ROWS 4
+#define SKETCH_WIDTH 4096                       /* power of two */
+#define THROTTLE_MAX_SLEEPERS 8
+
+struct sketch {
+  volatile long long epoch;
+  volatile unsigned int counters[SKETCH_ROWS][SKETCH_WIDTH];
+};
+
+static struct sketch sketches[2];
+static pthread_mutex_t rotate_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int sleepers;
+
+volatile long long throttle_rejects;
+volatile long long throttle_delays;
+
+static unsigned long long key_hash(const char *prefix, const char *user,
+                                   const char *host)
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  const char *parts[3];
+  int i;
+
+  parts[0] = prefix;
+  parts[1] = user;
+  parts[2] = host;
+  for (i = 0; i < 3; i++) {
+    const char *p = parts[i];
+    for (; p && *p; p++)
+      hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+    hash = (hash ^ 0xff) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+/* rows use h1 + i * h2, as good as independent hashes for a sketch */
+static unsigned int row_index(unsigned long long hash, int row)
+{
+  unsigned int h1 = (unsigned int)hash, h2 = (unsigned int)(hash >> 32) | 1;
+  return (h1 + row * h2) & (SKETCH_WIDTH - 1);
+}
+
+static long long current_epoch(void)
+{
+  return time(NULL) / (throttle_window ? throttle_window : 1);
+}
+
+/* the sketch of the given epoch, cleared first if it holds an old one */
+static struct sketch *sketch_for(long long epoch)
+{
+  struct sketch *s = &sketches[epoch & 1];
+
+  if (s->epoch != epoch) {
+    pthread_mutex_lock(&rotate_lock);
+    if (s->epoch != epoch) {
+      memset((void *)s->counters, 0, sizeof(s->counters));
+      __sync_synchronize();
+      s->epoch = epoch;
+    }
+    pthread_mutex_unlock(&rotate_lock);
+  }
+  return s;
+}
+
+static unsigned int sketch_estimate(const struct sketch *s, long long epoch,
+                                    unsigned long long hash)
+{
+  unsigned int estimate = ~0U;
+  int row;
+
+  if (s->epoch != epoch)
+    return 0;
+  for (row = 0; row < SKETCH_ROWS; row++) {
+    unsigned int count = s->counters[row][row_index(hash, row)];
+    if (count < estimate)
+      estimate = count;
+  }
+  return estimate;
+}
+
+static unsigned int failures(long long epoch, unsigned long long hash)
+{
+  return sketch_estimate(&sketches[epoch & 1], epoch, hash) +
+         sketch_estimate(&sketches[(epoch - 1) & 1], epoch - 1, hash);
+}
+
+void throttle_init(void)
+{
+  memset(sketches, 0, sizeof(sketches));
+  sketches[0].epoch = sketches[1].epoch = -1;
+  throttle_rejects = 0;
+  throttle_delays = 0;
+  sleepers = 0;
+}
+
+int throttle_enabled(void)
+{
+  return throttle_host_threshold || throttle_user_threshold;
+}
+
+enum throttle_result throttle_check(const char *user, const char *host)
+{
+  long long epoch = current_epoch();
+  int over = 0;
+
+  if (throttle_host_threshold &&
+      failures(epoch, key_hash("h", NULL, host)) >= throttle_host_threshold)
+    over = 1;
+  if (throttle_user_threshold &&
+      failures(epoch, key_hash("u", user, host)) >= throttle_user_threshold)
+    over = 1;
+
+  if (!over)
+    return THROTTLE_PASS;
+
+  if (!throttle_delay ||
+      __sync_add_and_fetch(&sleepers, 1) > THROTTLE_MAX_SLEEPERS) {
+    if (throttle_delay)
+      __sync_sub_and_fetch(&sleepers, 1);
+    __sync_add_and_fetch(&throttle_rejects, 1);
+    return THROTTLE_REJECT;
+  }
+
+  /* tarpit: the client still gets its answer, only later */
+  __sync_add_and_fetch(&throttle_delays, 1);
+  usleep(throttle_delay * 1000);
+  __sync_sub_and_fetch(&sleepers, 1);
+  return THROTTLE_DELAYED;
+}
+
+void throttle_record_failure(const char *user, const char *host)
+{
+  struct sketch *s = sketch_for(current_epoch());
+  unsigned long long hashes[2];
+  int i, row;
+
+  hashes[0] = key_hash("h", NULL, host);
+  hashes[1] = key_hash("u", user, host);
+  for (i = 0; i < 2; i++)
+    for (row = 0; row < SKETCH_ROWS; row++)
+      __sync_add_and_fetch(&s->counters[row][row_index(hashes[i], row)], 1);
+}
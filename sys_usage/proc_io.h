@@ -0,0 +1,67 @@
+#ifndef SYS_USAGE_PROC_IO
+#define SYS_USAGE_PROC_IO
+/*
+   Copyright (c) 2012, PaynetEasy. All rights reserved.
+   Licence: GPL
+   Description: /proc/<pid>/io reader shared by sys_usage, metrics_exporter
+                and audit_syslog.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* per-process I/O accounting from /proc/<pid>/io */
+struct proc_io
+{
+  ulonglong rchar, wchar, syscr, syscw;
+  ulonglong read_bytes, write_bytes, cancelled_write_bytes;
+};
+
+/*
+  Reads with open()/read() into a stack buffer and parses in place, so
+  that it can run on a statement path without allocating.
+*/
+static inline bool read_proc_io(const char *path, proc_io *io)
+{
+  char buf[512];
+  ssize_t len;
+  int fd= open(path, O_RDONLY);
+  if (fd < 0)
+    return true;
+  len= read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (len <= 0)
+    return true;
+  buf[len]= 0;
+
+  memset(io, 0, sizeof(*io));
+  for (char *line= buf; *line; )
+  {
+    char *colon= strchr(line, ':');
+    char *end;
+    if (!colon)
+      break;
+    *colon= 0;
+    ulonglong value= strtoull(colon + 1, &end, 10);
+    if (!strcmp(line, "rchar"))
+      io->rchar= value;
+    else if (!strcmp(line, "wchar"))
+      io->wchar= value;
+    else if (!strcmp(line, "syscr"))
+      io->syscr= value;
+    else if (!strcmp(line, "syscw"))
+      io->syscw= value;
+    else if (!strcmp(line, "read_bytes"))
+      io->read_bytes= value;
+    else if (!strcmp(line, "write_bytes"))
+      io->write_bytes= value;
+    else if (!strcmp(line, "cancelled_write_bytes"))
+      io->cancelled_write_bytes= value;
+    line= end + (*end == '\n');
+  }
+  return false;
+}
+
+#endif
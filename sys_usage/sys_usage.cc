@@ -10,6 +10,26 @@ bool schema_table_store_record(THD *thd,TABLE *table);
   #include <sys/sysinfo.h>    //getrusage
 #endif
 
+#ifdef __linux__
+  #include "mysqld.h"           // mysql_real_data_home, mysql_tmpdir
+  #include "set_var.h"          // intern_find_sys_var
+  #include "proc_io.h"          // read_proc_io
+  #include <stdio.h>
+  #include <sys/stat.h>
+  #include <sys/sysmacros.h>    // major, minor
+  #include <time.h>             // clock_gettime
+  #include <dirent.h>
+  #include <linux/perf_event.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+  #include <fcntl.h>
+  #include <arpa/inet.h>        // inet_ntop
+  #include <netinet/tcp.h>      // TCP_LISTEN
+  #include <linux/netlink.h>
+  #include <linux/sock_diag.h>
+  #include <linux/inet_diag.h>
+#endif
+
 /*insert macro*/
 #define INSERT(NAME,VALUE)                            \
   table->field[0]->store(NAME, sizeof(NAME)-1, cs);   \
@@ -25,6 +45,195 @@ ST_FIELD_INFO sys_usage_fields[]=
   {"VALUE", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
   {0, 0, MYSQL_TYPE_NULL, 0, 0, 0, 0}
 };
+
+ST_FIELD_INFO sys_disk_usage_fields[]=
+{
+  {"ROLE", 16, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"PATH", FN_REFLEN, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"DEVICE", 32, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"READS", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"READ_BYTES", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"WRITES", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"WRITE_BYTES", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"IN_FLIGHT", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"IO_TIME_MS", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"WEIGHTED_IO_TIME_MS", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"QUEUE_NR_REQUESTS", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"ROTATIONAL", 1, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"READ_IOPS", 21, MYSQL_TYPE_DOUBLE, 0, 0, 0, 0},
+  {"WRITE_IOPS", 21, MYSQL_TYPE_DOUBLE, 0, 0, 0, 0},
+  {"UTILIZATION", 21, MYSQL_TYPE_DOUBLE, 0, 0, 0, 0},
+  {0, 0, MYSQL_TYPE_NULL, 0, 0, 0, 0}
+};
+
+ST_FIELD_INFO sys_perf_counters_fields[]=
+{
+  {"THREAD_OS_ID", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"CYCLES", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_MAYBE_NULL, 0, 0},
+  {"INSTRUCTIONS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_MAYBE_NULL, 0, 0},
+  {"CACHE_MISSES", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_MAYBE_NULL, 0, 0},
+  {"BRANCH_MISSES", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_MAYBE_NULL, 0, 0},
+  {"CONTEXT_SWITCHES", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_MAYBE_NULL, 0, 0},
+  {"CPU_MIGRATIONS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_MAYBE_NULL, 0, 0},
+  {"PAGE_FAULTS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_MAYBE_NULL, 0, 0},
+  {"IPC", 21, MYSQL_TYPE_DOUBLE, 0, MY_I_S_MAYBE_NULL, 0, 0},
+  {"CACHE_MISSES_PER_KI", 21, MYSQL_TYPE_DOUBLE, 0, MY_I_S_MAYBE_NULL, 0, 0},
+  {"BRANCH_MISSES_PER_KI", 21, MYSQL_TYPE_DOUBLE, 0, MY_I_S_MAYBE_NULL, 0, 0},
+  {"UNMONITORED_THREADS", 20, MYSQL_TYPE_LONGLONG, 0, MY_I_S_MAYBE_NULL, 0, 0},
+  {0, 0, MYSQL_TYPE_NULL, 0, 0, 0, 0}
+};
+
+ST_FIELD_INFO sys_listen_sockets_fields[]=
+{
+  {"PROTOCOL", 8, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"LOCAL_ADDRESS", 64, MYSQL_TYPE_STRING, 0, 0, 0, 0},
+  {"LOCAL_PORT", 5, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"ACCEPT_QUEUE", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"ACCEPT_QUEUE_MAX", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {"INODE", 20, MYSQL_TYPE_LONGLONG, 0, 0, 0, 0},
+  {0, 0, MYSQL_TYPE_NULL, 0, 0, 0, 0}
+};
+
+#ifdef __linux__
+/*
+  Open descriptors by type.  /proc/self/fd is read with getdents64 into a
+  stack buffer and each link is read with readlinkat, so the scan costs
+  two syscalls per descriptor and no allocations unless socket inodes
+  are collected.
+*/
+struct linux_dirent64
+{
+  ino64_t d_ino;
+  off64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[1];
+};
+
+struct fd_counts
+{
+  ulonglong total, sockets, files, pipes, eventfds, other;
+};
+
+struct inode_set
+{
+  ulonglong *inodes;
+  uint count, size;
+};
+
+static void inode_set_add(inode_set *set, ulonglong inode)
+{
+  if (set->count == set->size)
+  {
+    uint size= set->size ? set->size * 2 : 256;
+    ulonglong *inodes= (ulonglong*) realloc(set->inodes, size * sizeof(ulonglong));
+    if (!inodes)
+      return;
+    set->inodes= inodes;
+    set->size= size;
+  }
+  set->inodes[set->count++]= inode;
+}
+
+static int compare_inodes(const void *a, const void *b)
+{
+  ulonglong x= *(const ulonglong*) a, y= *(const ulonglong*) b;
+  return x < y ? -1 : x > y;
+}
+
+static bool inode_set_contains(const inode_set *set, ulonglong inode)
+{
+  return set->count &&
+         bsearch(&inode, set->inodes, set->count, sizeof(ulonglong), compare_inodes);
+}
+
+/* socket_inodes may be NULL when only the counts are needed */
+static bool scan_open_fds(fd_counts *counts, inode_set *socket_inodes)
+{
+  char buf[8192], link[64];
+  int dir= open("/proc/self/fd", O_RDONLY | O_DIRECTORY);
+  long nread;
+
+  if (dir < 0)
+    return true;
+
+  memset(counts, 0, sizeof(*counts));
+  while ((nread= syscall(SYS_getdents64, dir, buf, sizeof(buf))) > 0)
+  {
+    for (long pos= 0; pos < nread; )
+    {
+      linux_dirent64 *de= (linux_dirent64*) (buf + pos);
+      pos+= de->d_reclen;
+      if (de->d_name[0] == '.')
+        continue;
+
+      ssize_t len= readlinkat(dir, de->d_name, link, sizeof(link) - 1);
+      if (len < 0)
+        continue;                               /* closed meanwhile */
+      link[len]= '\0';
+      counts->total++;
+
+      if (!strncmp(link, "socket:[", 8))
+      {
+        counts->sockets++;
+        if (socket_inodes)
+          inode_set_add(socket_inodes, strtoull(link + 8, NULL, 10));
+      }
+      else if (!strncmp(link, "pipe:[", 6))
+        counts->pipes++;
+      else if (!strcmp(link, "anon_inode:[eventfd]"))
+        counts->eventfds++;
+      else if (link[0] == '/')
+        counts->files++;
+      else
+        counts->other++;
+    }
+  }
+  close(dir);
+
+  /* the descriptor of /proc/self/fd itself was counted as a file */
+  if (counts->total)
+  {
+    counts->total--;
+    counts->files--;
+  }
+  if (socket_inodes)
+    qsort(socket_inodes->inodes, socket_inodes->count, sizeof(ulonglong), compare_inodes);
+  return false;
+}
+
+/* ListenOverflows and ListenDrops from the TcpExt lines of /proc/net/netstat */
+static bool read_listen_drops(ulonglong *overflows, ulonglong *drops)
+{
+  char names[4096], values[4096];
+  bool found= false;
+  FILE *f= fopen("/proc/self/net/netstat", "r");
+  if (!f)
+    return true;
+
+  while (!found && fgets(names, sizeof(names), f) && fgets(values, sizeof(values), f))
+  {
+    if (strncmp(names, "TcpExt:", 7) || strncmp(values, "TcpExt:", 7))
+      continue;
+
+    char *name_ptr, *value_ptr;
+    char *name= strtok_r(names + 7, " \n", &name_ptr);
+    char *value= strtok_r(values + 7, " \n", &value_ptr);
+    for (; name && value; name= strtok_r(NULL, " \n", &name_ptr),
+                          value= strtok_r(NULL, " \n", &value_ptr))
+    {
+      if (!strcmp(name, "ListenOverflows"))
+        *overflows= strtoull(value, NULL, 10);
+      else if (!strcmp(name, "ListenDrops"))
+        *drops= strtoull(value, NULL, 10);
+    }
+    found= true;
+  }
+  fclose(f);
+  return !found;
+}
+#endif
+
   
 #if MYSQL_VERSION_ID > 50600
 static int fill_sys_usage(THD *thd, TABLE_LIST *tables, Item *item)
@@ -107,9 +316,743 @@ static int fill_sys_usage(THD *thd, TABLE_LIST *tables, COND *cond)
     INSERT("Maximum number of files", r_limit.rlim_cur);
   #endif
 
+  #ifdef __linux__
+    /*
+     /proc/self/io counts I/O at the syscall level (rchar, wchar) and at
+     the storage level (read_bytes, write_bytes), so page cache hits and
+     O_DIRECT traffic can be told apart, unlike ru_inblock/ru_oublock.
+    */
+    proc_io p_io;
+    if (!read_proc_io("/proc/self/io", &p_io))
+    {
+      INSERT("characters read", p_io.rchar);
+      INSERT("characters written", p_io.wchar);
+      INSERT("read syscalls", p_io.syscr);
+      INSERT("write syscalls", p_io.syscw);
+      INSERT("bytes read from storage", p_io.read_bytes);
+      INSERT("bytes written to storage", p_io.write_bytes);
+      INSERT("cancelled write bytes", p_io.cancelled_write_bytes);
+    }
+
+    /* how close "Maximum number of files" is, and what holds the descriptors */
+    fd_counts fds;
+    if (!scan_open_fds(&fds, NULL))
+    {
+      INSERT("open file descriptors", fds.total);
+      INSERT("open sockets", fds.sockets);
+      INSERT("open files", fds.files);
+      INSERT("open pipes", fds.pipes);
+      INSERT("open eventfds", fds.eventfds);
+      INSERT("open other descriptors", fds.other);
+    }
+
+    ulonglong listen_overflows= 0, listen_drops= 0;
+    if (!read_listen_drops(&listen_overflows, &listen_drops))
+    {
+      INSERT("listen queue overflows", listen_overflows);
+      INSERT("listen queue drops", listen_drops);
+    }
+  #endif
+
+  return 0;
+}
+
+#ifdef __linux__
+/*
+  SYS_DISK_USAGE: block device statistics for the devices backing
+  the data directory, the InnoDB redo log and tmpdir.
+*/
+
+#define DISK_SECTOR_SIZE 512
+#define MAX_TRACKED_DISKS 8
+
+struct disk_stats
+{
+  uint major, minor;
+  char name[32];
+  ulonglong reads, reads_merged, sectors_read, read_ms;
+  ulonglong writes, writes_merged, sectors_written, write_ms;
+  ulonglong in_flight, io_ms, weighted_io_ms;
+};
+
+/* a device with its rates, computed once per fill for all its roles */
+struct disk_usage
+{
+  disk_stats ds;
+  double read_iops, write_iops, utilization;
+};
+
+/*
+  Baseline sample of each device.  Rates are derived against it only
+  once it is DISK_RATE_MIN_MS old, readers in between get the rates of
+  the last full interval, so concurrent reads do not reset each other.
+*/
+#define DISK_RATE_MIN_MS 1000
+
+struct disk_sample
+{
+  uint major, minor;
+  ulonglong time_ms;
+  ulonglong reads, writes, io_ms;
+  double read_iops, write_iops, utilization;
+};
+
+static disk_sample disk_samples[MAX_TRACKED_DISKS];
+static uint disk_samples_count= 0;
+static pthread_mutex_t disk_samples_lock= PTHREAD_MUTEX_INITIALIZER;
+
+static ulonglong monotonic_ms()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ulonglong) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* read one "<number>\n" file from sysfs */
+static bool read_sys_ulonglong(const char *path, ulonglong *value)
+{
+  FILE *f= fopen(path, "r");
+  if (!f)
+    return true;
+  bool error= fscanf(f, "%llu", value) != 1;
+  fclose(f);
+  return error;
+}
+
+/* find the /proc/diskstats line of the device major:minor */
+static bool read_disk_stats(uint major_no, uint minor_no, disk_stats *ds)
+{
+  char line[512];
+  bool found= false;
+  FILE *f= fopen("/proc/diskstats", "r");
+  if (!f)
+    return true;
+
+  while (!found && fgets(line, sizeof(line), f))
+  {
+    if (sscanf(line, "%u %u %31s %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+               &ds->major, &ds->minor, ds->name,
+               &ds->reads, &ds->reads_merged, &ds->sectors_read, &ds->read_ms,
+               &ds->writes, &ds->writes_merged, &ds->sectors_written, &ds->write_ms,
+               &ds->in_flight, &ds->io_ms, &ds->weighted_io_ms) == 14)
+      found= ds->major == major_no && ds->minor == minor_no;
+  }
+  fclose(f);
+  return !found;
+}
+
+/*
+  Queue attributes live on the whole disk: for a partition
+  /sys/dev/block/M:m points at .../sda/sda1, so look one level up.
+*/
+static ulonglong read_queue_attr(const disk_stats *ds, const char *attr)
+{
+  char path[FN_REFLEN];
+  ulonglong value= 0;
+
+  snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/queue/%s", ds->major, ds->minor, attr);
+  if (read_sys_ulonglong(path, &value))
+  {
+    snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/../queue/%s", ds->major, ds->minor, attr);
+    read_sys_ulonglong(path, &value);
+  }
+  return value;
+}
+
+/* redo log location as configured in InnoDB, datadir when InnoDB is absent */
+static const char *redo_log_dir(THD *thd)
+{
+  const char *dir= NULL;
+  LEX_STRING base= { NULL, 0 };
+
+  mysql_rwlock_rdlock(&LOCK_system_variables_hash);
+  sys_var *var= intern_find_sys_var(STRING_WITH_LEN("innodb_log_group_home_dir"));
+  if (var)
+    dir= *(const char **) var->value_ptr(thd, OPT_GLOBAL, &base);
+  mysql_rwlock_unlock(&LOCK_system_variables_hash);
+
+  return dir ? dir : mysql_real_data_home;
+}
+
+/*
+  Compute IOPS and utilization over the last interval of at least
+  DISK_RATE_MIN_MS.  The first read has no baseline and averages since boot.
+*/
+static void derive_disk_rates(disk_usage *du)
+{
+  const disk_stats *ds= &du->ds;
+  ulonglong now= monotonic_ms();
+  disk_sample *slot= NULL;
+
+  pthread_mutex_lock(&disk_samples_lock);
+  for (uint i= 0; i < disk_samples_count && !slot; i++)
+    if (disk_samples[i].major == ds->major && disk_samples[i].minor == ds->minor)
+      slot= &disk_samples[i];
+  if (!slot && disk_samples_count < MAX_TRACKED_DISKS)
+  {
+    /* CLOCK_MONOTONIC starts at boot, as do the diskstats counters */
+    slot= &disk_samples[disk_samples_count++];
+    memset(slot, 0, sizeof(*slot));
+    slot->major= ds->major;
+    slot->minor= ds->minor;
+  }
+  if (!slot)
+  {
+    pthread_mutex_unlock(&disk_samples_lock);
+    du->read_iops= du->write_iops= du->utilization= 0;
+    return;
+  }
+
+  ulonglong elapsed_ms= now - slot->time_ms;
+  if (elapsed_ms >= DISK_RATE_MIN_MS || !slot->time_ms)
+  {
+    if (elapsed_ms == 0 || ds->reads < slot->reads || ds->writes < slot->writes)
+      slot->read_iops= slot->write_iops= slot->utilization= 0;
+    else
+    {
+      slot->read_iops= (ds->reads - slot->reads) * 1000.0 / elapsed_ms;
+      slot->write_iops= (ds->writes - slot->writes) * 1000.0 / elapsed_ms;
+      slot->utilization= min((ds->io_ms - slot->io_ms) * 100.0 / elapsed_ms, 100.0);
+    }
+    slot->time_ms= now;
+    slot->reads= ds->reads;
+    slot->writes= ds->writes;
+    slot->io_ms= ds->io_ms;
+  }
+  du->read_iops= slot->read_iops;
+  du->write_iops= slot->write_iops;
+  du->utilization= slot->utilization;
+  pthread_mutex_unlock(&disk_samples_lock);
+}
+
+/* devices[] caches the devices already read in this fill */
+static int store_disk_usage(THD *thd, TABLE *table, const char *role, const char *path,
+                            disk_usage *devices, uint *device_count)
+{
+  CHARSET_INFO *cs= system_charset_info;
+  struct stat st;
+  disk_usage *du= NULL;
+
+  if (!path || stat(path, &st))
+    return 0;
+  for (uint i= 0; i < *device_count && !du; i++)
+    if (devices[i].ds.major == major(st.st_dev) && devices[i].ds.minor == minor(st.st_dev))
+      du= &devices[i];
+  if (!du)
+  {
+    /* tmpfs, overlayfs and friends have no block device behind them */
+    du= &devices[*device_count];
+    if (read_disk_stats(major(st.st_dev), minor(st.st_dev), &du->ds))
+      return 0;
+    derive_disk_rates(du);
+    (*device_count)++;
+  }
+
+  const disk_stats &ds= du->ds;
+
+  table->field[0]->store(role, strlen(role), cs);
+  table->field[1]->store(path, strlen(path), cs);
+  table->field[2]->store(ds.name, strlen(ds.name), cs);
+  table->field[3]->store(ds.reads, 1);
+  table->field[4]->store(ds.sectors_read * DISK_SECTOR_SIZE, 1);
+  table->field[5]->store(ds.writes, 1);
+  table->field[6]->store(ds.sectors_written * DISK_SECTOR_SIZE, 1);
+  table->field[7]->store(ds.in_flight, 1);
+  table->field[8]->store(ds.io_ms, 1);
+  table->field[9]->store(ds.weighted_io_ms, 1);
+  table->field[10]->store(read_queue_attr(&ds, "nr_requests"), 1);
+  table->field[11]->store(read_queue_attr(&ds, "rotational"), 1);
+  table->field[12]->store(du->read_iops);
+  table->field[13]->store(du->write_iops);
+  table->field[14]->store(du->utilization);
+  return schema_table_store_record(thd, table);
+}
+#endif
+
+#if MYSQL_VERSION_ID > 50600
+static int fill_sys_disk_usage(THD *thd, TABLE_LIST *tables, Item *item)
+#else
+static int fill_sys_disk_usage(THD *thd, TABLE_LIST *tables, COND *cond)
+#endif
+{
+  #ifdef __linux__
+    TABLE *table= tables->table;
+    disk_usage devices[3];
+    uint device_count= 0;
+
+    if (store_disk_usage(thd, table, "datadir", mysql_real_data_home, devices, &device_count) ||
+        store_disk_usage(thd, table, "redo log", redo_log_dir(thd), devices, &device_count) ||
+        store_disk_usage(thd, table, "tmpdir", mysql_tmpdir, devices, &device_count))
+      return 1;
+  #endif
+
   return 0;
 }
  
+/*
+   Plugin system variables for SHOW VARIABLES
+*/
+static uint perf_max_threads= 64;
+
+static MYSQL_SYSVAR_UINT(max_threads, perf_max_threads,
+                         PLUGIN_VAR_RQCMDARG | PLUGIN_VAR_READONLY,
+                         "Number of threads to attach counters to, 0 disables counters; "
+                         "the ones beyond it show in UNMONITORED_THREADS. "
+                         "Each thread holds 7 file descriptors, counted against "
+                         "open_files_limit: raise it by 7 times this value",
+                         NULL, NULL, 64, 0, 65536, 0);
+
+static struct st_mysql_sys_var* sys_perf_counters_sysvars[] = {
+    MYSQL_SYSVAR(max_threads),
+    NULL
+};
+
+#ifdef __linux__
+/*
+  SYS_PERF_COUNTERS: per-thread perf_event counter groups.  A background
+  thread scans /proc/self/task every PERF_RESCAN_INTERVAL_MS, and so do
+  reads of the table; a thread gets its counters when a scan first sees
+  it, so values count from that moment and threads living shorter than a
+  scan interval are missed.  A tid reused by a new thread is told apart
+  by its start time.  Each group is read with a single read() call.
+
+  Threads beyond sys_perf_counters_max_threads get no counters.  The
+  aggregate row, THREAD_OS_ID 0, then covers the monitored threads only,
+  and its UNMONITORED_THREADS tells how many running threads it misses.
+*/
+
+#define PERF_RESCAN_INTERVAL_MS 1000
+
+#define HW_COUNTERS 4           /* cycles, instructions, cache misses, branch misses */
+#define SW_COUNTERS 3           /* context switches, CPU migrations, page faults */
+
+struct perf_group_read
+{
+  ulonglong nr;
+  ulonglong time_enabled;
+  ulonglong time_running;
+  ulonglong values[HW_COUNTERS];
+};
+
+struct perf_thread
+{
+  pid_t tid;
+  ulonglong start_time;         /* in clock ticks since boot */
+  int hw_fds[HW_COUNTERS];      /* hw_fds[0] is the group leader, -1 if unavailable */
+  int sw_fds[SW_COUNTERS];
+  bool seen;
+};
+
+struct perf_totals
+{
+  ulonglong hw[HW_COUNTERS];
+  ulonglong sw[SW_COUNTERS];
+  bool has_hw, has_sw;
+};
+
+static const uint hw_events[HW_COUNTERS]=
+{
+  PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+static const uint sw_events[SW_COUNTERS]=
+{
+  PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_CPU_MIGRATIONS,
+  PERF_COUNT_SW_PAGE_FAULTS
+};
+
+static perf_thread *perf_threads= NULL;
+static uint perf_threads_count= 0;
+static perf_totals perf_retired;        /* counts of threads that exited */
+static uint perf_unmonitored= 0;        /* running threads without counters */
+static bool perf_hw_unavailable= false; /* e.g. a VM without a virtual PMU */
+static pthread_mutex_t perf_lock= PTHREAD_MUTEX_INITIALIZER;
+
+/* background scanner, protected by perf_lock */
+static pthread_t perf_scanner;
+static bool perf_scanner_running= false;
+static bool perf_scanner_stop= false;
+static pthread_cond_t perf_scanner_cond= PTHREAD_COND_INITIALIZER;
+
+static int perf_open(uint type, uint config, pid_t tid, int group_fd, bool user_only)
+{
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size= sizeof(attr);
+  attr.type= type;
+  attr.config= config;
+  attr.read_format= PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                    PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.exclude_kernel= user_only;
+  attr.exclude_hv= 1;
+  return (int) syscall(SYS_perf_event_open, &attr, tid, -1, group_fd, 0);
+}
+
+static void perf_close_group(int *fds, uint count)
+{
+  for (uint i= count; i-- > 0; )
+  {
+    if (fds[i] >= 0)
+      close(fds[i]);
+    fds[i]= -1;
+  }
+}
+
+/*
+  Open a counter group led by its first event.  With perf_event_paranoid
+  at 2 counting kernel code is refused, so retry user space only.
+*/
+static bool perf_open_group(int *fds, const uint *events, uint count,
+                            uint type, pid_t tid)
+{
+  for (uint i= 0; i < count; i++)
+    fds[i]= -1;
+
+  fds[0]= perf_open(type, events[0], tid, -1, false);
+  bool user_only= fds[0] < 0 && errno == EACCES;
+  if (user_only)
+    fds[0]= perf_open(type, events[0], tid, -1, true);
+  if (fds[0] < 0)
+    return true;
+
+  for (uint i= 1; i < count; i++)
+    if ((fds[i]= perf_open(type, events[i], tid, fds[0], user_only)) < 0)
+    {
+      perf_close_group(fds, count);
+      return true;
+    }
+  return false;
+}
+
+/* one read() per group; counts are scaled up if the PMU was multiplexed */
+static bool perf_read_group(int leader, uint count, ulonglong *values)
+{
+  perf_group_read data;
+  ssize_t expected= (3 + count) * sizeof(ulonglong);
+
+  if (leader < 0 || read(leader, &data, sizeof(data)) != expected || data.nr != count)
+    return true;
+
+  for (uint i= 0; i < count; i++)
+  {
+    values[i]= data.values[i];
+    if (data.time_running && data.time_running < data.time_enabled)
+      values[i]= (ulonglong) ((double) values[i] * data.time_enabled / data.time_running);
+  }
+  return false;
+}
+
+/* starttime, field 22 of /proc/self/task/<tid>/stat; 0 if the task is gone */
+static ulonglong task_start_time(pid_t tid)
+{
+  char path[64], buf[1024];
+  snprintf(path, sizeof(path), "/proc/self/task/%d/stat", (int) tid);
+  int fd= open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  ssize_t len= read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (len <= 0)
+    return 0;
+  buf[len]= 0;
+
+  /* the command in field 2 may contain spaces, count fields after it */
+  char *p= strrchr(buf, ')');
+  for (uint field= 2; p && field < 22; field++)
+    p= strchr(p + 1, ' ');
+  return p ? strtoull(p + 1, NULL, 10) : 0;
+}
+
+/* false if the thread got counters */
+static bool perf_attach(perf_thread *pt, pid_t tid, ulonglong start_time)
+{
+  if (!perf_hw_unavailable &&
+      perf_open_group(pt->hw_fds, hw_events, HW_COUNTERS, PERF_TYPE_HARDWARE, tid) &&
+      (errno == ENOENT || errno == ENODEV || errno == EOPNOTSUPP))
+    perf_hw_unavailable= true;
+  if (perf_hw_unavailable)
+    for (uint i= 0; i < HW_COUNTERS; i++)
+      pt->hw_fds[i]= -1;
+
+  if (perf_open_group(pt->sw_fds, sw_events, SW_COUNTERS, PERF_TYPE_SOFTWARE, tid) &&
+      pt->hw_fds[0] < 0)
+    return true;
+
+  pt->tid= tid;
+  pt->start_time= start_time;
+  pt->seen= true;
+  return false;
+}
+
+static void perf_add(perf_totals *totals, const ulonglong *hw, const ulonglong *sw)
+{
+  for (uint i= 0; hw && i < HW_COUNTERS; i++)
+    totals->hw[i]+= hw[i];
+  for (uint i= 0; sw && i < SW_COUNTERS; i++)
+    totals->sw[i]+= sw[i];
+  totals->has_hw|= hw != NULL;
+  totals->has_sw|= sw != NULL;
+}
+
+/* counters of an exited task can still be read: keep them in the totals */
+static void perf_retire(perf_thread *pt)
+{
+  ulonglong hw[HW_COUNTERS], sw[SW_COUNTERS];
+  bool hw_ok= !perf_read_group(pt->hw_fds[0], HW_COUNTERS, hw);
+  bool sw_ok= !perf_read_group(pt->sw_fds[0], SW_COUNTERS, sw);
+  perf_add(&perf_retired, hw_ok ? hw : NULL, sw_ok ? sw : NULL);
+  perf_close_group(pt->hw_fds, HW_COUNTERS);
+  perf_close_group(pt->sw_fds, SW_COUNTERS);
+}
+
+/* attach counters to new threads, retire the ones of exited threads */
+static void perf_rescan_threads()
+{
+  DIR *dir= opendir("/proc/self/task");
+  dirent *de;
+
+  if (!dir)
+    return;
+
+  for (uint i= 0; i < perf_threads_count; i++)
+    perf_threads[i].seen= false;
+  perf_unmonitored= 0;
+
+  while ((de= readdir(dir)))
+  {
+    pid_t tid= (pid_t) atoi(de->d_name);
+    ulonglong start_time;
+    uint i;
+    if (tid <= 0 || !(start_time= task_start_time(tid)))
+      continue;
+    for (i= 0; i < perf_threads_count && perf_threads[i].tid != tid; i++)
+      ;
+    if (i < perf_threads_count)
+    {
+      perf_thread *pt= &perf_threads[i];
+      if (pt->start_time == start_time)
+      {
+        pt->seen= true;
+        continue;
+      }
+      /* the tid now belongs to a new thread */
+      perf_retire(pt);
+      if (!(pt->seen= !perf_attach(pt, tid, start_time)))
+        perf_unmonitored++;
+    }
+    else if (perf_threads_count < perf_max_threads &&
+             !perf_attach(&perf_threads[perf_threads_count], tid, start_time))
+      perf_threads_count++;
+    else
+      perf_unmonitored++;
+  }
+  closedir(dir);
+
+  for (uint i= 0; i < perf_threads_count; )
+  {
+    perf_thread *pt= &perf_threads[i];
+    if (pt->seen)
+    {
+      i++;
+      continue;
+    }
+    perf_retire(pt);
+    *pt= perf_threads[--perf_threads_count];
+  }
+}
+
+static void *perf_scanner_main(void *arg __attribute__((unused)))
+{
+  pthread_mutex_lock(&perf_lock);
+  while (!perf_scanner_stop)
+  {
+    perf_rescan_threads();
+
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec+= PERF_RESCAN_INTERVAL_MS / 1000;
+    deadline.tv_nsec+= (PERF_RESCAN_INTERVAL_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec-= 1000000000L;
+    }
+    pthread_cond_timedwait(&perf_scanner_cond, &perf_lock, &deadline);
+  }
+  pthread_mutex_unlock(&perf_lock);
+  return NULL;
+}
+
+/* unmonitored is the count of the aggregate row, NULL for a thread (-1) */
+static int store_perf_counters(THD *thd, TABLE *table, ulonglong tid,
+                               const ulonglong *hw, const ulonglong *sw,
+                               longlong unmonitored)
+{
+  for (uint i= 1; i < 12; i++)
+    table->field[i]->set_notnull();
+
+  table->field[0]->store(tid, 1);
+  for (uint i= 0; i < HW_COUNTERS; i++)
+    if (hw)
+      table->field[1 + i]->store(hw[i], 1);
+    else
+      table->field[1 + i]->set_null();
+  for (uint i= 0; i < SW_COUNTERS; i++)
+    if (sw)
+      table->field[5 + i]->store(sw[i], 1);
+    else
+      table->field[5 + i]->set_null();
+
+  /* hw[1] is instructions: IPC, then misses per thousand instructions */
+  if (hw && hw[1])
+  {
+    table->field[8]->store(hw[0] ? (double) hw[1] / hw[0] : 0.0);
+    table->field[9]->store(hw[2] * 1000.0 / hw[1]);
+    table->field[10]->store(hw[3] * 1000.0 / hw[1]);
+  }
+  else
+    for (uint i= 8; i < 11; i++)
+      table->field[i]->set_null();
+
+  if (unmonitored >= 0)
+    table->field[11]->store(unmonitored, 1);
+  else
+    table->field[11]->set_null();
+
+  return schema_table_store_record(thd, table);
+}
+#endif
+
+#if MYSQL_VERSION_ID > 50600
+static int fill_sys_perf_counters(THD *thd, TABLE_LIST *tables, Item *item)
+#else
+static int fill_sys_perf_counters(THD *thd, TABLE_LIST *tables, COND *cond)
+#endif
+{
+  #ifdef __linux__
+    TABLE *table= tables->table;
+    perf_totals totals;
+    uint unmonitored;
+    int error= 0;
+
+    if (!perf_threads)
+      return 0;
+
+    pthread_mutex_lock(&perf_lock);
+    perf_rescan_threads();
+    totals= perf_retired;
+    unmonitored= perf_unmonitored;
+    for (uint i= 0; i < perf_threads_count && !error; i++)
+    {
+      perf_thread *pt= &perf_threads[i];
+      ulonglong hw[HW_COUNTERS], sw[SW_COUNTERS];
+      const ulonglong *hw_ptr= perf_read_group(pt->hw_fds[0], HW_COUNTERS, hw) ? NULL : hw;
+      const ulonglong *sw_ptr= perf_read_group(pt->sw_fds[0], SW_COUNTERS, sw) ? NULL : sw;
+
+      perf_add(&totals, hw_ptr, sw_ptr);
+      error= store_perf_counters(thd, table, pt->tid, hw_ptr, sw_ptr, -1);
+    }
+    pthread_mutex_unlock(&perf_lock);
+
+    /* THREAD_OS_ID 0 is the aggregate over monitored threads, exited ones included */
+    if (!error && (totals.has_hw || totals.has_sw))
+      error= store_perf_counters(thd, table, 0, totals.has_hw ? totals.hw : NULL,
+                                 totals.has_sw ? totals.sw : NULL, unmonitored);
+    return error;
+  #else
+    return 0;
+  #endif
+}
+
+#ifdef __linux__
+/*
+  SYS_LISTEN_SOCKETS: TCP sockets mysqld listens on.  sock_diag reports a
+  listening socket's accept queue length in idiag_rqueue and its limit,
+  min(back_log, somaxconn), in idiag_wqueue.  The Unix socket has no
+  accept queue counters there and is not listed.
+*/
+static int store_listen_sockets(THD *thd, TABLE *table, const char *protocol,
+                                int family, const inode_set *sockets)
+{
+  CHARSET_INFO *cs= system_charset_info;
+  char buf[8192], address[INET6_ADDRSTRLEN];
+  int error= 0;
+  bool done= false;
+  struct
+  {
+    nlmsghdr nlh;
+    inet_diag_req_v2 req;
+  } request;
+
+  int fd= socket(AF_NETLINK, SOCK_DGRAM, NETLINK_SOCK_DIAG);
+  if (fd < 0)
+    return 0;
+
+  memset(&request, 0, sizeof(request));
+  request.nlh.nlmsg_len= sizeof(request);
+  request.nlh.nlmsg_type= SOCK_DIAG_BY_FAMILY;
+  request.nlh.nlmsg_flags= NLM_F_REQUEST | NLM_F_DUMP;
+  request.req.sdiag_family= family;
+  request.req.sdiag_protocol= IPPROTO_TCP;
+  request.req.idiag_states= 1 << TCP_LISTEN;
+  if (send(fd, &request, sizeof(request), 0) < 0)
+    done= true;
+
+  while (!done && !error)
+  {
+    ssize_t len= recv(fd, buf, sizeof(buf), 0);
+    if (len <= 0)
+      break;
+
+    for (nlmsghdr *nlh= (nlmsghdr*) buf; NLMSG_OK(nlh, len) && !error;
+         nlh= NLMSG_NEXT(nlh, len))
+    {
+      if (nlh->nlmsg_type == NLMSG_DONE || nlh->nlmsg_type == NLMSG_ERROR)
+      {
+        done= true;
+        break;
+      }
+      inet_diag_msg *msg= (inet_diag_msg*) NLMSG_DATA(nlh);
+      if (!inode_set_contains(sockets, msg->idiag_inode) ||
+          !inet_ntop(family, msg->id.idiag_src, address, sizeof(address)))
+        continue;
+
+      table->field[0]->store(protocol, strlen(protocol), cs);
+      table->field[1]->store(address, strlen(address), cs);
+      table->field[2]->store(ntohs(msg->id.idiag_sport), 1);
+      table->field[3]->store(msg->idiag_rqueue, 1);
+      table->field[4]->store(msg->idiag_wqueue, 1);
+      table->field[5]->store(msg->idiag_inode, 1);
+      error= schema_table_store_record(thd, table);
+    }
+  }
+  close(fd);
+  return error;
+}
+#endif
+
+#if MYSQL_VERSION_ID > 50600
+static int fill_sys_listen_sockets(THD *thd, TABLE_LIST *tables, Item *item)
+#else
+static int fill_sys_listen_sockets(THD *thd, TABLE_LIST *tables, COND *cond)
+#endif
+{
+  #ifdef __linux__
+    TABLE *table= tables->table;
+    inode_set sockets= { NULL, 0, 0 };
+    fd_counts fds;
+    int error= 0;
+
+    if (!scan_open_fds(&fds, &sockets))
+      error= store_listen_sockets(thd, table, "tcp", AF_INET, &sockets) ||
+             store_listen_sockets(thd, table, "tcp6", AF_INET6, &sockets);
+    free(sockets.inodes);
+    return error;
+  #else
+    return 0;
+  #endif
+}
+
 int sys_usage_init(void *p)
 {
   ST_SCHEMA_TABLE *schema= (ST_SCHEMA_TABLE*) p;
@@ -122,7 +1065,67 @@ static int sys_usage_deinit(void *p)
 {
   return 0;
 }
+
+int sys_disk_usage_init(void *p)
+{
+  ST_SCHEMA_TABLE *schema= (ST_SCHEMA_TABLE*) p;
+  schema->fields_info= sys_disk_usage_fields;
+  schema->fill_table= fill_sys_disk_usage;
+  return 0;
+}
  
+int sys_perf_counters_init(void *p)
+{
+  ST_SCHEMA_TABLE *schema= (ST_SCHEMA_TABLE*) p;
+  schema->fields_info= sys_perf_counters_fields;
+  schema->fill_table= fill_sys_perf_counters;
+  #ifdef __linux__
+    if (perf_max_threads &&
+        !(perf_threads= (perf_thread*) calloc(perf_max_threads, sizeof(perf_thread))))
+      return 1;
+    perf_scanner_stop= false;
+    if (perf_threads)
+      perf_scanner_running= !pthread_create(&perf_scanner, NULL, perf_scanner_main, NULL);
+  #endif
+  return 0;
+}
+
+static int sys_perf_counters_deinit(void *p)
+{
+  #ifdef __linux__
+    if (perf_scanner_running)
+    {
+      pthread_mutex_lock(&perf_lock);
+      perf_scanner_stop= true;
+      pthread_cond_signal(&perf_scanner_cond);
+      pthread_mutex_unlock(&perf_lock);
+      pthread_join(perf_scanner, NULL);
+      perf_scanner_running= false;
+    }
+    for (uint i= 0; i < perf_threads_count; i++)
+    {
+      perf_close_group(perf_threads[i].hw_fds, HW_COUNTERS);
+      perf_close_group(perf_threads[i].sw_fds, SW_COUNTERS);
+    }
+    perf_threads_count= 0;
+    free(perf_threads);
+    perf_threads= NULL;
+    /* a reinstall starts over, the PMU may have become available */
+    memset(&perf_retired, 0, sizeof(perf_retired));
+    perf_hw_unavailable= false;
+    perf_unmonitored= 0;
+  #endif
+  return 0;
+}
+
+int sys_listen_sockets_init(void *p)
+{
+  ST_SCHEMA_TABLE *schema= (ST_SCHEMA_TABLE*) p;
+  schema->fields_info= sys_listen_sockets_fields;
+  schema->fill_table= fill_sys_listen_sockets;
+  return 0;
+}
+
 struct st_mysql_information_schema is_sys_usage=
 {
   MYSQL_INFORMATION_SCHEMA_INTERFACE_VERSION  /* interface version    */
@@ -146,5 +1149,50 @@ mysql_declare_plugin(mysql_is_sys_usage)
   NULL,                                       /* system variables                */
   NULL,                                       /* config options                  */
   0,                                          /* flags                           */
+},
+{
+  MYSQL_INFORMATION_SCHEMA_PLUGIN,            /* type                            */
+  &is_sys_usage,                              /* descriptor                      */
+  "SYS_DISK_USAGE",                           /* name                            */
+  "PaynetEasy",                               /* author                          */
+  "Block device usage of datadir, redo log and tmpdir", /* description           */
+  PLUGIN_LICENSE_GPL,
+  sys_disk_usage_init,                        /* init function (when loaded)     */
+  sys_usage_deinit,                           /* deinit function (when unloaded) */
+  0x0010,                                     /* version                         */
+  NULL,                                       /* status variables                */
+  NULL,                                       /* system variables                */
+  NULL,                                       /* config options                  */
+  0,                                          /* flags                           */
+},
+{
+  MYSQL_INFORMATION_SCHEMA_PLUGIN,            /* type                            */
+  &is_sys_usage,                              /* descriptor                      */
+  "SYS_PERF_COUNTERS",                        /* name                            */
+  "PaynetEasy",                               /* author                          */
+  "Per-thread hardware and software performance counters", /* description        */
+  PLUGIN_LICENSE_GPL,
+  sys_perf_counters_init,                     /* init function (when loaded)     */
+  sys_perf_counters_deinit,                   /* deinit function (when unloaded) */
+  0x0010,                                     /* version                         */
+  NULL,                                       /* status variables                */
+  sys_perf_counters_sysvars,                  /* system variables                */
+  NULL,                                       /* config options                  */
+  0,                                          /* flags                           */
+},
+{
+  MYSQL_INFORMATION_SCHEMA_PLUGIN,            /* type                            */
+  &is_sys_usage,                              /* descriptor                      */
+  "SYS_LISTEN_SOCKETS",                       /* name                            */
+  "PaynetEasy",                               /* author                          */
+  "Accept queues of the TCP sockets mysqld listens on", /* description           */
+  PLUGIN_LICENSE_GPL,
+  sys_listen_sockets_init,                    /* init function (when loaded)     */
+  sys_usage_deinit,                           /* deinit function (when unloaded) */
+  0x0010,                                     /* version                         */
+  NULL,                                       /* status variables                */
+  NULL,                                       /* system variables                */
+  NULL,                                       /* config options                  */
+  0,                                          /* flags                           */
 }
 mysql_declare_plugin_end;